@@ -33,10 +33,17 @@
 #include <stdio.h>  // For sprintf() usage
 
 #include "./libraries/always.h"  // Useful structures and unions
+#include "./libraries/bits.h"    // Register and bit-field access
+#include "./libraries/boot.h"    // Overlapped start-up and warm reset
+#include "./libraries/defer.h"   // Interrupt events handled in the main loop
 #include "./libraries/delay.h"   // Several delays
+#include "./libraries/input.h"   // Debounced key events
 #include "./libraries/key.h"     // To use the board's switch
 #include "./libraries/lcd8x2.h"  // LCD for the robot
+#include "./libraries/params.h"  // Parameters tuned over the serial channel
+#include "./libraries/power.h"   // Sensor supply gating and sleep
 #include "./libraries/sensor.h"  // Line sensors, proximity sensors, and buzzer
+#include "./libraries/serial.h"  // To use the serial communication channel
 #include "./libraries/spi.h"     // SPI interface
 
 // Definitions
@@ -46,51 +53,51 @@
 #define LED RB5     // Output bit for the LED
 #define BUZZER RB7  // Bit for the buzzer
 
+// Inputs
+#define KEY_PIN PORTB, 0  // The board's key (bits.h descriptor), low when pressed
+#define KEY 0             // Its input number, see input.h
+
+// Events from the interrupt, see defer.h
+enum { EV_INPUT, EV_TYPES };
+
+// Tunable parameters, see params.h for the serial commands
+// ID, name, type, min, max, default
+#define PARAMS(X) X(P_SAMPLE_TICKS, "ticks", PARAM_U8, 1, 255, 50)
+
+PARAM_TABLE(PARAMS);
 
 // Definition of a global array to store the values of the measurements
 volatile int counter = 0;
 volatile int sum = 0;
+uint8_t presses = 0;  // Key presses not handled yet, counted in the main loop
 
 void __interrupt() isr() {  // General interrupt handling routine
-    // Locally declared static variables retain their value
-    static int tick;  // Counter of times Timer 0 interrupts
-
     // Timer 0
     // Interrupts approximately every 5 ms.
-    // Flashes the LED approximately every 1 second.
-    // Controls the debounce time of the switch in conjunction with the I-O-C of PORT B
+    // Debounces the key
     if (T0IE && T0IF) {  // If it is an interrupt from Timer 0
-        // Here the Timer 0 flag is used to determine when the AD conversion
-        // should be performed
+        // Times the sensor supply and the AD conversions read in the main loop,
+        // and the buzzer
         // If Timer 0 interrupts every 5 ms, 50 ticks correspond to 250 ms
         // 4 * 250 ms = 1 s (4 AD measurements every second)
-        if (++tick >= 50) {
-            tick = 0;
-            counter++;
-            sum += sensorNear_read();
-        }
+        power_tick();
+        boot_tick();  // start-up timing
 
-        // Debounce da chave. Deve ser incluído na interrupção periódica de Timer.
-        // São 2 ciclos para debounce entre 5 e 10 ms para interrupção de ~5ms.
-        // Deve ser alterado de acordo com o tempo dado pela interrupção do Timer.
-        // Por exemplo, se a interrupção for a cada 1 ms, o parâmetro deve ser 10
-        // o que resulta num debounce de 9 a 10 ms.
-        key_debounce(2);  // 2 is the number of cycles to achieve 5 to 10 ms
+        // Key debounce: 4 equal samples, 15 to 20 ms, then a press or
+        // release event is posted for the main loop
+        input_tick(pin_test(KEY_PIN) ? 0 : BIT(KEY));
 
         TMR0 = 0xff - 98;  // TMR0_SETTING; reloads the count in Timer 0
         T0IF = 0;          // clears the interrupt flag
     }                      // end - handling of Timer 0
 
     // Interrupt-on-change of PORT B
-    // The debounce time is controlled by Timer 0. The change of state of the switch
-    // triggers a time count by Timer 0 from 5 to 10 ms. Every time there is a
-    // change of state of the switch, the debounce time count is reset.
-
-    if (RBIE && RBIF) {      // If it is a change of state in Port B
-        char portB = PORTB;  // Reads Port B, resetting the interrupt condition along with RBIF = 0
-        key_read(portB);     // Reads the key
-        RBIF = 0;            // Resets the interrupt flag to be able to receive another interruption
-    }                        // End - handling I-O-C PORT B
+    // Only enabled by power_sleep(), so that the key wakes the PIC; awake, the
+    // key is sampled by Timer 0.
+    if (RBIE && RBIF) {  // If it is a change of state in Port B
+        (void)PORTB;     // Reading Port B ends the change condition
+        RBIF = 0;        // Resets the interrupt flag
+    }                    // End - handling I-O-C PORT B
 
 }  // End - Handling of all interruptions
 
@@ -98,6 +105,11 @@ void __interrupt() isr() {  // General interrupt handling routine
 /*--------------------------------------------------------------------------------*/
 // Auxiliary functions
 
+/// Key events, run by defer_dispatch() in the main loop
+void key_event(uint8_t arg) {
+    if (INPUT_NUMBER(arg) == KEY && INPUT_TYPE(arg) == INPUT_PRESS && presses < 255) presses++;
+}
+
 // Timer 0 Initialization
 void t0_init(void) {
     // Timer 0 is used for periodic interruption approximately every 5 ms
@@ -121,22 +133,32 @@ void buzzer_init(void) {
     BUZZER = 0;
 }
 
-/// To use the BUZZER, SENSOR POWER must be turned on.
-void beep() {           /// Plays a beep
-    BUZZER = ON;        // Turn on buzzer
-    delay_big_ms(300);  // for 0.3s
-    BUZZER = OFF;       // Turn off buzzer
+/// LCD ready for the program: no cursor, blank
+void screen_init(void) {
+    lcd_init();            // Initialize LCD
+    lcd_clear();           // Clear LCD, should not be used within loops as it takes a long time
+    lcd_show_cursor(OFF);  // Turn off LCD cursor
 }
 
 /// Displays the initial message on the LCD - adapted from HW-Test
-void welcome_message() {
+void welcome_message(void) {
     lcd_goto(0);        // Go to the beginning of the 1st line
     lcd_puts("AT04");   // Display the string with the activity number on the LCD
     delay_ms(1);        // Allow time for the display to show the message
     lcd_goto(64);       // Go to the beginning of the 2nd line
     lcd_puts("T1-G5");  // Group and team number
+    power_beep(300);    // Play a beep to signal that it is ready
 }
 
+/// Start-up steps, see boot.h; the message is shown after a power-up only
+enum { S_SCREEN, S_WELCOME, S_STEPS };
+
+const struct boot_step boot_steps[S_STEPS] = {
+    // init, ready, start_ms, settle_ms, needs, flags
+    {screen_init, NULL, BOOT_LCD_MS, 0, 0, 0},
+    {welcome_message, NULL, 0, 0, BOOT_NEED(S_SCREEN), BOOT_COLD},
+};
+
 
 /*--------------------------------------------------------------------------------*/
 
@@ -151,56 +173,75 @@ void main(void) {
     // Initializations
 
     // Initialize the robot
+    boot_init();    // Reset cause, before anything else
+    key_init();     // Key pin and its interrupt-on-change, for the wake-up
+    RBIE = 0;       // awake, the key is sampled by Timer 0 instead
+    defer_init();   // Events from the interrupt, before it is enabled
+    defer_register(EV_INPUT, key_event);
+    input_init(EV_INPUT);  // Key debounce, presses posted as events
+    t0_init();      // Initialize Timer 0 for periodic interruption (~5 ms)
+    GIE = 1;        // Enable interruptions: the start-up is timed from here
+
     spi_init();     // Initialize SPI for peripheral use
-    lcd_init();     // Initialize LCD
     sensor_init();  // Initialize sensors
 
     // Local board initializations
-    t0_init();      // Initialize Timer 0 for periodic interruption (~5 ms)
-    key_init();     // Initialize the key
     led_init();     // Initialize LED for debugging
     buzzer_init();  // Initialize buzzer
-
-    // Interruption control
-    GIE = 1;  // Enable interruptions
+    serial_init();  // Initialize serial channel for tuning
+    param_init();   // Saved parameters, or the defaults
+    power_init();   // Sensor supply off until samples are due
     LED = 0;
 
-    // Initial configurations
-
-    // Sensors
-    sensor_power(ON);  // Turn on sensor power, takes 40 ms to turn on the proximity sensor
-
-    // LCD
-    delay_s(4);            // Wait to read the reset message
-    lcd_clear();           // Clear LCD, should not be used within loops as it takes a long time
-    lcd_show_cursor(OFF);  // Turn off LCD cursor
-
-    // Initial message on LCD
-    welcome_message();  // Display initial message on LCD
-    beep();             // Play a beep to signal that it is ready
+    // LCD and initial message, after a power-up only
+    boot_run(boot_steps, S_STEPS);
 
     char text1[9];  // Auxiliary string for 8 characters
     char text2[9];  // Auxiliary string for 8 characters
-    char keyIn = FALSE;
     int mean = 0;
 
     while (1) {
-        keyIn = key_pressed();
+        CLRWDT();  // in case the watchdog is enabled
+
+        defer_dispatch();  // presses made during the last 100 ms are counted here
+        keyIn = presses != 0;
+        if (keyIn) presses--;  // one per pass, the others wait
 
         if (keyIn == TRUE) {
             counter = 0;
             sum = 0;
             LED = ~LED;
-            beep();
+            power_beep(300);
+            power_activity();
         }
 
-        if (counter == 9) {
+        if (counter == 10) {
             mean = sum / 10;  // Force conversion to int
             sprintf(text2, "%5d", mean);
             lcd_goto(64);     // Go to the beginning of the 1st line
             lcd_puts(text2);  // Display string on LCD to check if it's working
         }
 
-        delay_ms(100);
+        // 100 ms between refreshes, taking the samples and reading parameter
+        // commands meanwhile. The sensor supply is only on for the 40 ms warm-up
+        // before each sample, and off once the 10 samples are taken.
+        for (int i = 0; i < 100; i++) {
+            power_sensors(counter < 10 ? param[P_SAMPLE_TICKS] * POWER_TICK_MS : 0);
+            if (power_sample()) {
+                sum += sensorNear_read();
+                counter++;
+                if (!boot_output_ms()) {  // time from reset to the first sample, on the serial channel
+                    boot_output();
+                    boot_report();
+                }
+            }
+            char c = chkchr();
+            if ((uint8_t)c != 255) power_activity();  // any command counts as activity
+            param_input(c);
+            delay_ms(1);
+        }
+
+        // Nothing to do for a minute: sleep until the key is pressed
+        if (counter >= 10 && power_sleepy()) power_sleep();
     }
 }
\ No newline at end of file
@@ -32,11 +32,16 @@
 
 #include "./libraries/always.h"   // Useful structures and unions
 #include "./libraries/battery.h"  // Robot's battery level measurement
+#include "./libraries/bits.h"     // Register and bit-field access
+#include "./libraries/boot.h"     // Overlapped start-up, warm reset, watchdog
 #include "./libraries/compass.h"  // Robot's compass
+#include "./libraries/defer.h"    // Interrupt events handled in the main loop
 #include "./libraries/delay.h"    // Several delays
+#include "./libraries/input.h"    // Debounced key events
 #include "./libraries/key.h"      // To use the board's switch
 #include "./libraries/lcd8x2.h"   // LCD for the robot
 #include "./libraries/led_rgb.h"  // Robot's RGB LED
+#include "./libraries/link.h"     // Addressed, acknowledged packet link
 #include "./libraries/sensor.h"   // Line sensors, proximity sensors, and buzzer
 #include "./libraries/serial.h"   // To use the serial communication channel
 #include "./libraries/spi.h"      // SPI interface
@@ -44,26 +49,43 @@
 // Definitions
 #define VERSION "2.3"
 
+// Link addresses: swap them on the other robot
+#define NODE_ADDR 1
+#define PEER_ADDR 2
+
 // Outputs
 #define LED RB5     // Output bit for the LED
 #define BUZZER RB7  // Bit for the buzzer
 
-// Macros
-#define testbit(var, bit) ((var) & (1 << (bit)))
-#define setbit(var, bit) ((var) |= (1 << (bit)))
-#define clrbit(var, bit) ((var) &= ~(1 << (bit)))
+// Inputs
+#define KEY_PIN PORTB, 0  // The board's key (bits.h descriptor), low when pressed
+#define KEY 0             // Its input number, see input.h
+
+// Events from the interrupt, see defer.h
+enum { EV_INPUT, EV_TYPES };
 
 volatile char current = '0';  // Volatile global variable to store the current character
+volatile uint16_t link_ms = 0;  // Time elapsed for the link, handed over in the main loop;
+                                // 16 bits, so a pass that blocks for seconds is still counted
+
+struct link link;
+struct link_io link_io;  // rings the interrupt fills and empties
+uint8_t presses = 0;     // key presses not handled yet, counted in the main loop
 
 /*----------------------------------------------------------------------------------------------------------------*/
 /* Auxiliary functions */
 
+// Key events, run by defer_dispatch() in the main loop
+void key_event(uint8_t arg) {
+    if (INPUT_NUMBER(arg) == KEY && INPUT_TYPE(arg) == INPUT_PRESS && presses < 255) presses++;
+}
+
 void __interrupt() isr(void) {
     static int tick = 0;  // Counter of times Timer 0 interrupts
 
     // Timer 0
     // Interrupts approximately every 5 ms.
-    // Controls the debounce time of the key in conjunction with the I-O-C of PORT B
+    // Debounces the key
 
     if (TMR0IE && TMR0IF) {
         if (++tick >= 10) {  // 5 ms * 10  = 50 ms
@@ -82,16 +104,27 @@ void __interrupt() isr(void) {
             }
         }
 
-        key_debounce(2);
+        input_tick(pin_test(KEY_PIN) ? 0 : BIT(KEY));  // key events for the main loop
+        link_ms += 5;
+        boot_tick();  // start-up timing
 
         TMR0 = 0xff - 98;
         TMR0IF = 0;
     }
 
-    if (RBIE && RBIF) {
-        char portB = PORTB;
-        key_read(portB);
-        RBIF = 0;
+    // Serial link: one byte each way, the frames are handled in the main loop
+    if (RCIE && RCIF) {
+        if (OERR) {  // clear a receive overrun
+            CREN = 0;
+            CREN = 1;
+        }
+        link_rx_byte(&link_io, RCREG);
+    }
+
+    if (TXIE && TXIF) {
+        int c = link_tx_next(&link_io);
+        if (c < 0) TXIE = 0;
+        else TXREG = (uint8_t)c;
     }
 
 }  // isr()
@@ -122,53 +155,78 @@ void buzzer_init(void) {
     BUZZER = 0;
 }
 
-void beep() {
+// The beep: boot_run() turns the buzzer off 200 ms later
+void beep_on(void) {
     BUZZER = ON;
-    delay_big_ms(200);
+}
+
+void beep_off(void) {
     BUZZER = OFF;
 }
 
-void welcome_message() {
+// LCD ready for the welcome message: no cursor, blank
+void screen_init(void) {
+    lcd_init();
+    lcd_clear();
+    lcd_show_cursor(OFF);
+}
+
+void welcome_message(void) {
     lcd_goto(0);
     lcd_puts("AT05");
     lcd_goto(64);
     lcd_puts("T1-G5");
-    delay_s(4);  // 4-second delay, could be done with interruption
 }
 
+// Cleared for the instructions, with the cursor on for aesthetic effect
+void screen_ready(void) {
+    lcd_clear();
+    lcd_show_cursor(ON);
+}
+
+// Start-up steps, see boot.h: the message and beep after a power-up only
+enum { S_SCREEN, S_WELCOME, S_BEEP, S_QUIET, S_READY, S_STEPS };
+
+const struct boot_step boot_steps[S_STEPS] = {
+    // init, ready, start_ms, settle_ms, needs, flags
+    {screen_init, NULL, BOOT_LCD_MS, 0, 0, 0},
+    {welcome_message, NULL, 0, 2000, BOOT_NEED(S_SCREEN), BOOT_COLD},
+    {beep_on, NULL, 0, 200, BOOT_NEED(S_SCREEN), BOOT_COLD},
+    {beep_off, NULL, 0, 0, BOOT_NEED(S_BEEP), 0},
+    {screen_ready, NULL, 0, 0, BOOT_NEED(S_WELCOME), 0},
+};
+
 
 /*----------------------------------------------------------------------------------------------------------------*/
 
 void main(void) {
-    char serialIn = 255;
     char keyIn = FALSE;
+    char pending = 0;  // character chosen but not yet accepted by the link
+    uint8_t src, data[LINK_MAX_PAYLOAD];
+    uint16_t ms;
+
+    boot_init();  // reset cause and watchdog period, before anything else
+    key_init();   // initialize key pin
+    RBIE = 0;     // the key is sampled by Timer 0, not on Port B changes
+    defer_init(); // events from the interrupt, before it is enabled
+    defer_register(EV_INPUT, key_event);
+    input_init(EV_INPUT);  // key debounce, presses posted as events
+    t0_init();    // initialize Timer 0 for periodic interruption (~5 ms)
+    GIE = 1;      // the start-up is timed from here
 
     spi_init();      // initialize SPI for LCD, LED RGB, battery, compass
     led_rgb_init();  // initialize RGB LED
     battery_init();  // initialize battery reading
     compass_init();  // initialize compass
     sensor_init();   // initialize sensors
-    lcd_init();      // initialize LCD
-    sensor_init();   // initialize sensors
 
     /* Local board initializations */
-    t0_init();      // initialize Timer 0 for periodic interruption (~5 ms)
     serial_init();  // initialize serial communication channel
-    key_init();     // initialize key
+    link_init(&link, &link_io, NODE_ADDR);  // frames over the serial channel, interrupt driven
     led_init();     // initialize LED for debugging
     buzzer_init();  // initialize buzzer
 
-    GIE = 1;
-
-    delay_s(2);
-    lcd_clear();
-    lcd_show_cursor(OFF);
-
-    welcome_message();  // write the welcome message
-    beep();             // sound signal
-    lcd_clear();        // clear the LCD for the next instructions
-
-    lcd_show_cursor(ON);  // turn on the cursor for aesthetic effect in the welcome message
+    boot_run(boot_steps, S_STEPS);  // LCD, welcome message and beep, side by side
 
     int pos = 0;    // auxiliary for the position of sent characters
     int pos2 = 64;  // auxiliary for the position of received characters
@@ -178,20 +236,24 @@ void main(void) {
     temp = '%';  // initialize with any value different from 0
 
     while (1) {                    // infinite loop
+        CLRWDT();                  // a pass takes well under the watchdog period
+
         if (current != temp) {     // if the index recorded in temp has changed
             lcd_goto(pos);         // go to the current position
             lcd_putchar(current);  // write character on the LCD
             temp = current;        // update temp
         }
 
-        keyIn = key_pressed();
+        defer_dispatch();  // key presses are counted here
+        keyIn = presses != 0;
+        if (keyIn) presses--;  // one press per pass, the others wait
 
         if (keyIn) {     // if the button is pressed
             pos++;       // move to the next position on the LCD
             temp = '%';  // reset temp (remembering that the value was
                          // chosen because it is impossible)
 
-            putch(current);  // send the character chosen by the serial channel
+            pending = current;  // send the character chosen by the serial channel
 
             if (pos > 7) {  // if the position exceeds the limit of characters on the display
                 pos = 0;    // return to position 0
@@ -201,12 +263,22 @@ void main(void) {
                             // zero in the new position
         }
 
-        serialIn = chkchr();  // receive the character
+        // Serial link: elapsed time, received bytes, acks and retransmissions
+        GIE = 0;
+        ms = link_ms;
+        link_ms = 0;
+        if (ms) link_tick(&link, ms);
+        GIE = 1;
+        link_poll(&link);
+
+        if (pending && link_send(&link, PEER_ADDR, (uint8_t *)&pending, 1)) {
+            pending = 0;  // queued; the link resends it until acknowledged
+        }
 
-        if (serialIn != 255) {      // detect arrival of character in the serial buffer
-            lcd_goto(pos2);         // go to the current position of the second line
-            pos2++;                 // increment the position for writing the next character
-            lcd_putchar(serialIn);  // write character on the LCD
+        if (link_recv(&link, &src, data) > 0) {  // detect arrival of a frame from the other robot
+            lcd_goto(pos2);          // go to the current position of the second line
+            pos2++;                  // increment the position for writing the next character
+            lcd_putchar(data[0]);    // write character on the LCD
 
             if (pos2 > 71) {  // if the position exceeds the limit of characters on the display
                 pos2 = 64;    // reset the value of pos2 to the first position on the second line
@@ -31,13 +31,22 @@
 #include <stdio.h>  // para poder usar sprintf()
 #include <xc.h>
 
+#include "./libraries/adcsync.h"  // Proximity sensor sampled in step with the PWM
 #include "./libraries/always.h"   // Useful structures and unions
+#include "./libraries/boot.h"     // Overlapped start-up, warm reset, watchdog
+#include "./libraries/compass.h"  // Robot's compass
 #include "./libraries/delay.h"    // Several delays
+#include "./libraries/encoder.h"  // Quadrature encoders of both wheels
+#include "./libraries/ffwd.h"     // Motor feed-forward table
 #include "./libraries/lcd8x2.h"   // LCD for the robot
 #include "./libraries/led_rgb.h"  // Robot's RGB LED
+#include "./libraries/mchar.h"    // Motor characterization
+#include "./libraries/odometry.h" // Dead-reckoning position and heading
+#include "./libraries/params.h"   // Parameters tuned over the serial channel
 #include "./libraries/sensor.h"   // Line sensors, proximity sensors, and buzzer
 #include "./libraries/serial.h"   // To use the serial communication channel
 #include "./libraries/spi.h"      // SPI interface
+#include "./libraries/ttc.h"      // Time-to-collision braking
 
 // Definitions
 #define VERSION "1.0"
@@ -46,97 +55,118 @@
 #define LED RB5     // bit de sa� da para o LED
 #define BUZZER RB7  // bit para buzzer
 
-__EEPROM_DATA(0, 1, -1, 0, -1, 0, 0, 1);
-__EEPROM_DATA(1, 0, 0, -1, 0, -1, 1, 0);
+#define NOISE_SAMPLES 64  // readings of each kind for 'N'
 
-volatile int16_t counter1 = 0;
-volatile int16_t counter2 = 0;
+// Encoder of the wheel on each PWM channel, see encoder.h
+#define ENC_RIGHT 2  // channel 1
+#define ENC_LEFT 1   // channel 2
+
+// compass_read() per full turn, clockwise: the compass library's own value when
+// compass.h gives one, the library is not part of this repository
+#ifndef COMPASS_FULL
+#define COMPASS_FULL 360
+#endif
+
+volatile char flag = 0;         // set every 100 ms by Timer 0 for the speed estimation
+volatile char sample_tick = 0;  // set every MCHAR_DT_MS by Timer 0 for the characterization
+volatile char ttc_tick = 0;     // set every TTC_DT_MS by Timer 0 for the obstacle filter
+
+// Tunable parameters, see params.h for the serial commands
+// ID, name, type, min, max, default
+#define PARAMS(X)                                     \
+    X(P_PWM_MAX, "pwmmax", PARAM_I16, 0, 1023, 60)    \
+    X(P_DIST_K, "distk", PARAM_I16, 1, 32000, 2914)   \
+    X(P_DIST_OFS, "distofs", PARAM_I16, 0, 100, 5)
+
+PARAM_TABLE(PARAMS);
 
 // Functions declarations
 void pwm_init(void);
+char pwm_synced(void);
 void pwm_set(int channel, int duty_cycle);
 void t0_init(void);
 void led_init(void);
 void buzzer_init(void);
-void beep(void);
+void beep_on(void);
+void beep_off(void);
+void screen_init(void);
 void welcome_message(void);
-
-volatile int last_state1 = 0;
-volatile int last_state2 = 0;
+void noise_report(void);
+uint16_t compass_brads(void);
+
+// Start-up steps, see boot.h: the LCD, the welcome message and beep (after
+// a power-up only) and the PWM start together
+enum { S_SCREEN, S_WELCOME, S_BEEP, S_QUIET, S_CLEAR, S_PWM, S_STEPS };
+
+const struct boot_step boot_steps[S_STEPS] = {
+    // init, ready, start_ms, settle_ms, needs, flags
+    {screen_init, NULL, BOOT_LCD_MS, 0, 0, 0},
+    {welcome_message, NULL, 0, 2000, BOOT_NEED(S_SCREEN), BOOT_COLD},
+    {beep_on, NULL, 0, 200, BOOT_NEED(S_SCREEN), BOOT_COLD},
+    {beep_off, NULL, 0, 0, BOOT_NEED(S_BEEP), 0},
+    {lcd_clear, NULL, 0, 0, BOOT_NEED(S_WELCOME), 0},
+    {pwm_init, pwm_synced, 0, 0, 0, 0},
+};
 
 void __interrupt() isr(void) {
     static int tick = 0;  // Counter of times Timer 0 interrupts
                           // Timer 0
                           // Interrupts approximately every 5 ms.
+    static char sample = 0;
+    static char obstacle = 0;
 
     if (TMR0IE && TMR0IF) {
         if (++tick >= 20) {  // 5 ms * 20 = 100 ms
             tick = 0;
+            flag = 1;
+        }
+
+        if (++sample >= MCHAR_DT_MS / 5) {
+            sample = 0;
+            sample_tick = 1;
+        }
+
+        if (++obstacle >= TTC_DT_MS / 5) {
+            obstacle = 0;
+            ttc_tick = 1;
         }
 
+        enc_sample();  // Timer 1 count of the hybrid encoder mode
+        boot_tick();   // start-up timing
+
         TMR0 = 0xff - 98;
         TMR0IF = 0;
     }
 
     // IOC PORTB
     if (RBIE && RBIF) {
-        char portB = PORTB;  // Reads PORTB, which also resets it
-
-        // Gets the current state
-        int state1 = (portB >> 3) & 0b11;
-        int state2 = (portB >> 1) & 0b11;
-
-        // Updates the counter values
-        counter1 += (signed char)EEPROM_READ(state1 + 4 * last_state1);
-        counter2 += (-1) * ((signed char)EEPROM_READ(state2 + 4 * last_state2));
-
-        // Updates the last state
-        last_state1 = state1;
-        last_state2 = state2;
-
-        RBIF = 0;  // Resets the interrupt flag
+        enc_isr(PORTB);  // Reads PORTB, which also resets it, and counts the edges
+        RBIF = 0;        // Resets the interrupt flag
     }
 }  // isr()
 
 
 void main(void) {
+    boot_init();  // reset cause and watchdog period, before anything else
+    enc_init();   // encoder inputs and their Port B interruption, see ENC_MODE
+    t0_init();    // initialize Timer 0 for periodic interruption (~5 ms)
+    GIE = 1;      // the start-up is timed from here
+
     spi_init();      // initialize SPI for LCD, LED RGB, battery, compass
     led_rgb_init();  // initialize RGB LED
-    sensor_init();
-    lcd_init();     // initialize LCD
-    sensor_init();  // initialize sensors
+    compass_init();  // initialize compass
+    sensor_init();   // initialize sensors
 
     // Local board initializations
-    t0_init();      // initialize Timer 0 for periodic interruption (~5 ms)
     led_init();     // initialize LED for debugging
     buzzer_init();  // initialize buzzer
-    pwm_init();
-
-    // Initialization of PORTB
-    IOCB = 0b00011110;  // enable IOC on encoder ports
-    RBIE = 1;           // enable Port B interruption
-
-    // Configuration of digital ports
-    // enable input
-    TRISB1 = 1;
-    TRISB2 = 1;
-    TRISB3 = 1;
-    TRISB4 = 1;
-
-    // configure as digital input
-    ANS10 = 0;
-    ANS8 = 0;
-    ANS9 = 0;
-    ANS11 = 0;
+    serial_init();  // initialize serial channel for tuning
+    param_init();   // saved parameters, or the defaults
+    ffwd_init();    // feed-forward table of the last characterization
+    odo_init();     // cart starts at (0, 0) facing 0
+    ttc_init();     // no obstacle yet
 
-    GIE = 1;
-
-    delay_s(2);
-    lcd_clear();
-    lcd_show_cursor(OFF);
-    welcome_message();  // write the welcome message
-    beep();             // sound signal
-    lcd_clear();        // clear the LCD for the next instructions
+    boot_run(boot_steps, S_STEPS);  // LCD, welcome message and PWM, side by side
 
     char str[9];
     int diff_count1 = 0;
@@ -147,14 +177,45 @@ void main(void) {
     int spd2 = 0;
     int spd;
     char text[9];  // auxiliary string for 8 characters
-    int AD_data, est;
-    int pwm_max = 60;
+    int AD_data = 0, est;
+    int16_t counter1, counter2;
+    int16_t duty1, duty2;
+    uint8_t command;
+    uint16_t compass_start = compass_brads();  // the compass heading odometry calls 0
 
     while (1) {
+        CLRWDT();  // the characterization and the LCD updates take well under the watchdog period
+
+        // Parameter commands on the serial channel; 'C' characterizes both motors (wheels off the ground),
+        // 'N' compares the proximity readings with the motors running
+        command = param_input(chkchr());
+        if (command == 'C' && !mchar_running()) {
+            lcd_clear();
+            lcd_puts("MOTORS");
+            mchar_start();
+        }
+        if (command == 'N' && !mchar_running()) noise_report();
+        if (mchar_running()) {
+            if (sample_tick) {
+                sample_tick = 0;
+                mchar_step(enc_count(ENC_RIGHT), enc_count(ENC_LEFT), &duty1, &duty2);
+                pwm_set(1, duty1);
+                pwm_set(2, duty2);
+            }
+            continue;  // nothing else drives the motors meanwhile
+        }
+
+        counter1 = enc_count(1);  // read once, the ISR keeps counting
+        counter2 = enc_count(2);
+
         // Counting encoder pulses
         // Display the count values on the LCD
         pwm_set(1, 600);
         pwm_set(2, 600);
+        if (!boot_output_ms()) {  // time from reset to the first output, on the serial channel
+            boot_output();
+            boot_report();
+        }
 
         sprintf(str, "r1: %4d", counter1);
         lcd_goto(0);
@@ -169,9 +230,13 @@ void main(void) {
 
             // calculate differences
             diff_count1 = counter1 - last1;
-            spd1 = (diff_count1 / 48) * 6.28 * 21 / 0.1;
+            spd1 = diff_count1 * 6.28 * 21 / 48 / 0.1;  // counts / 48 last, or below one turn per 100 ms it is 0
             diff_count2 = counter2 - last2;
-            spd2 = (diff_count2 / 48) * 6.28 * 21 / 0.1;
+            spd2 = diff_count2 * 6.28 * 21 / 48 / 0.1;
+
+            // integrate position and heading from both wheels, the compass takes out the drift
+            odo_update(diff_count1, diff_count2);
+            odo_compass(compass_brads() - compass_start);
 
             // update stored values
             last1 = counter1;
@@ -187,22 +252,20 @@ void main(void) {
             flag = 0;  // reset the flag
         }
 
-        // Routine to avoid obstacles
-        AD_data = sensorNear_read();  // read the value of the proximity sensor
-        est = ((2914 / (AD_data + 5)) - 1) * 10;
+        // Routine to avoid obstacles: the time-to-collision filter takes the
+        // proximity reading and the wheels' own speed every TTC_DT_MS
+        if (ttc_tick) {
+            ttc_tick = 0;
+            AD_data = sensorNear_read();  // read the value of the proximity sensor
+            ttc_update(AD_data, (spd1 + spd2) / 2);
+        }
+        est = ((param[P_DIST_K] / (AD_data + param[P_DIST_OFS])) - 1) * 10;
         sprintf(text, "%04d mm", est);  // create a string with the value
 
-        est /= 10;
-
-        if (est <= 20)  // if the cart is 20 cm or less from an obstacle
-        {
-            // the cart's speed decreases linearly to zero as it approaches an obstacle
-            spd = (est - 4) / est * pwm_max;
-            pwm_set(1, spd);
-            pwm_set(2, spd);
-        } else {                  // if the cart is more than 20 cm away from the obstacle
-            pwm_set(1, pwm_max);  // speed is maximum
-        }
+        // the faster the cart closes on an obstacle, the sooner it slows; 0 at the clearance
+        spd = ttc_duty_limit(param[P_PWM_MAX]);
+        pwm_set(1, spd);
+        pwm_set(2, spd);
 
         // display distance reading
         lcd_goto(0);
@@ -245,12 +308,15 @@ void pwm_init(void) {
     TMR2IF = 0;            // Clear TMR2 flag
     T2CONbits.T2CKPS = 0;  // Configure pre-scaler to 1:1
     TMR2ON = 1;            // Turn on TMR2
+}
 
-    while (!TMR2IF)
-        ;  // Wait for TMR2 overflow to start PWM cycle
-
+// Enables the outputs once TMR2 has overflowed and a full PWM cycle starts;
+// polled by boot_run() instead of waiting for it
+char pwm_synced(void) {
+    if (!TMR2IF) return FALSE;
     TRISC2 = 0;  // Enable output (CCP1 - enhanced)
     TRISC1 = 0;  // Enable output (CCP2)
+    return TRUE;
 }
 
 
@@ -287,16 +353,58 @@ void buzzer_init(void) {
     BUZZER = 0;
 }
 
-void beep(void) {
+// The beep: boot_run() turns the buzzer off 200 ms later
+void beep_on(void) {
     BUZZER = ON;
-    delay_big_ms(200);
+}
+
+void beep_off(void) {
     BUZZER = OFF;
 }
 
+// LCD ready for the program: no cursor, blank
+void screen_init(void) {
+    lcd_init();
+    lcd_clear();
+    lcd_show_cursor(OFF);
+}
+
 void welcome_message(void) {
     lcd_goto(0);
     lcd_puts("AT06");
     lcd_goto(64);
     lcd_puts("T1-G5");
-    delay_s(2);
+}
+
+// Compass heading in brads, counter-clockwise like odometry.h
+uint16_t compass_brads(void) {
+    int reading = compass_read() % COMPASS_FULL;
+
+    if (reading < 0) reading += COMPASS_FULL;
+    return (uint16_t)-(int32_t)((uint32_t)reading * 65536UL / COMPASS_FULL);
+}
+
+// 'N': NOISE_SAMPLES proximity readings of each kind, taken in turns with the
+// motors as they are, as "N,kind,mean,variance,min,max"
+void noise_report(void) {
+    static const char *const kind[2] = {"free", "sync"};
+    uint32_t sum[2] = {0, 0}, sum2[2] = {0, 0}, variance;
+    uint16_t low[2] = {1023, 1023}, high[2] = {0, 0};
+    uint16_t value, mean;
+    uint8_t i, k;
+
+    for (i = 0; i < NOISE_SAMPLES; i++) {
+        for (k = 0; k < 2; k++) {
+            value = k ? adcsync_read() : (uint16_t)sensorNear_read();
+            sum[k] += value;
+            sum2[k] += (uint32_t)value * value;  // 64 * 1023^2 fits
+            if (value < low[k]) low[k] = value;
+            if (value > high[k]) high[k] = value;
+        }
+    }
+    for (k = 0; k < 2; k++) {
+        mean = (uint16_t)(sum[k] / NOISE_SAMPLES);
+        variance = (sum2[k] - sum[k] * sum[k] / NOISE_SAMPLES) / NOISE_SAMPLES;
+        printf("N,%s,%u,%lu,%u,%u\n", kind[k], mean, (unsigned long)variance, low[k], high[k]);
+    }
 }
\ No newline at end of file
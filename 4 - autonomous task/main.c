@@ -31,15 +31,33 @@
 #include <stdio.h>  // For sprintf() usage
 #include <xc.h>
 
+#include "./libraries/adcsync.h"  // Proximity sensor sampled in step with the PWM
 #include "./libraries/always.h"   // Useful structures and unions
+#include "./libraries/battery.h"  // Robot's battery level measurement
+#include "./libraries/bits.h"     // Register and bit-field access
+#include "./libraries/blackbox.h" // EEPROM run log
+#include "./libraries/boot.h"     // Overlapped start-up, warm reset, watchdog
+#include "./libraries/curve.h"    // Line-sensor edge timing and tape curvature
+#include "./libraries/defer.h"    // Interrupt work deferred to the main loop
 #include "./libraries/delay.h"    // Several delays
+#include "./libraries/drive.h"    // Signed wheel duty, direction bits and braking
+#include "./libraries/encoder.h"  // Wheel encoders
+#include "./libraries/ffwd.h"     // Matched, linear wheel speeds
+#include "./libraries/follow.h"   // Wheel speeds from the line sensor
+#include "./libraries/input.h"    // Debounced key events
 #include "./libraries/key.h"      // To use the board's switch
 #include "./libraries/lcd8x2.h"   // LCD for the robot
 #include "./libraries/led_rgb.h"  // Robot's RGB LED
+#include "./libraries/odometry.h" // Wheel geometry
+#include "./libraries/params.h"   // Parameters tuned over the serial channel
+#include "./libraries/power.h"    // Sensor supply, LED and buzzer timing, sleep
+#include "./libraries/profile.h"  // Acceleration-limited wheel speeds
 #include "./libraries/pwm.h"      // PWM for tests
 #include "./libraries/sensor.h"   // Line sensors, proximity sensors, and buzzer
 #include "./libraries/serial.h"   // To use the serial communication channel
 #include "./libraries/spi.h"      // SPI interface
+#include "./libraries/ttc.h"      // Time-to-collision and braking
+#include "./libraries/vbat.h"     // Battery-voltage compensation of the duty cycle
 
 // Definitions
 #define VERSION "1.0"
@@ -48,14 +66,73 @@
 #define LED RB5     // Output bit for the LED
 #define BUZZER RB7  // Bit for the buzzer
 
+// Inputs
+#define KEY_PIN PORTB, 0  // The board's key (bits.h descriptor), low when pressed
+#define KEY 0             // Its input number, see input.h
+
+// Interrupt events handled by the main loop, see defer.h
+enum { EV_EEPROM, EV_LINE, EV_INPUT, EV_TYPES };
+#if DEFER_RING > 15
+#error "DEFER_RING must fit the stop record's high nibble"
+#endif
+
+// Encoder of the wheel on each PWM channel, see encoder.h
+#define ENC_RIGHT 2  // channel 1
+#define ENC_LEFT 1   // channel 2
+
+// Control period: proximity filter and wheel profiles advance together
+#define CONTROL_DT_MS 40
+#if TTC_DT_MS != CONTROL_DT_MS || PROFILE_DT_MS != CONTROL_DT_MS
+#error "TTC_DT_MS and PROFILE_DT_MS must match CONTROL_DT_MS"
+#endif
+
+volatile char control_tick = 0;  // set every CONTROL_DT_MS by Timer 0
+volatile char line_sampling = FALSE;  // Timer 0 asks for line sensor readings, see curve.h
+volatile char line_due = FALSE;       // an EV_LINE reading is waiting in the defer ring
+uint8_t presses = 0;                  // key presses not handled yet, counted by key_event()
+
+// Define as a free pin, set as an output, to raise it for the whole
+// interrupt and measure the worst case with a scope, see README "Interrupt time"
+// #define ISR_TIMING_PIN RA5
+
+int full_mmps = TTC_MMPS_FULL;  // cart speed at TTC_DUTY_FULL of the profile's unit, see full_speed()
+
+// Not cleared at start-up: after a watchdog or brown-out reset in the middle
+// of a run, the run goes on. The check byte rejects what a power-up leaves.
+__persistent uint8_t running, running_check;
+
+#define SUMMARY_TICKS 250  // control ticks between black-box summaries (10 s)
+                           // the records' lap byte stays 0, no track map is kept
+
+// Tunable parameters, see params.h for the serial commands
+// ID, name, type, min, max, default
+#define PARAMS(X)                                             \
+    X(P_DUTY_MAX, "dutymax", PARAM_I16, 0, 1023, 550)         \
+    X(P_TURN_PCT, "turn", PARAM_U8, 0, 100, 50)               \
+    X(P_ACCEL, "accel", PARAM_I16, 100, 20000, 1500)          \
+    X(P_DECEL, "decel", PARAM_I16, 100, 20000, 2500)          \
+    X(P_JERK, "jerk", PARAM_I16, 0, 30000, 15000)             \
+    X(P_CLEAR, "clear", PARAM_I16, 20, 250, TTC_CLEARANCE_MM) \
+    X(P_ANTIC, "antic", PARAM_U8, 0, 200, 0)                  \
+    X(P_PIVOT, "pivot", PARAM_U8, 0, 100, 0)                  \
+    X(P_ADSYNC, "adsync", PARAM_U8, 0, 1, 0)
+
+PARAM_TABLE(PARAMS);
+
 void __interrupt() isr(void) {
     // Local variables declared static retain their values
     static int tick = 0;  // Timer 0 interruption counter
+    static char control = 0;  // Timer 0 interruptions since the last control tick
+    static uint8_t ticks = 0;  // Timer 0 interruptions, for the line sensor readings
+
+#ifdef ISR_TIMING_PIN
+    ISR_TIMING_PIN = 1;
+#endif
 
     // Timer 0
     // Interrupts every approximately 5 ms.
     // Blinks the LED every approximately 1 second.
-    // Controls the debounce time of the switch in conjunction with the I-O-C of PORT B
+    // Debounces the switch
     if (TMR0IE && TMR0IF) {  // if it's a Timer 0 interruption
 
         // Toggle the LED every second
@@ -63,27 +140,48 @@ void __interrupt() isr(void) {
             tick = 0;         // reset the counter
         }                     // end - counting how many times the interruption occurs
 
-        // Switch debounce. It should be included in the periodic Timer interruption.
-        // It takes 2 cycles to debounce between 5 and 10 ms for an interruption of ~5ms.
-        // It should be changed according to the time given by the Timer interruption.
-        // For example, if the interruption is every 1 ms, the parameter should be 10
-        // resulting in a debounce of 9 to 10 ms.
-        key_debounce(2);  // 2 is the number of cycles to give 5 to 10 ms
+        if (++control >= CONTROL_DT_MS / 5) {  // proximity sensor refresh period
+            control = 0;
+            control_tick = 1;
+        }
+
+        // Switch debounce: 4 equal samples, 15 to 20 ms, then a press or
+        // release event is posted for the main loop (EV_INPUT)
+        input_tick(pin_test(KEY_PIN) ? 0 : BIT(KEY));
+
+        // line sensor every tick, read by the main loop (EV_LINE) with the
+        // tick it belongs to, so its conversions stay out of the interrupt
+        ticks++;
+        if (line_sampling && !line_due) {
+            line_due = TRUE;
+            if (!defer_post(EV_LINE, ticks)) line_due = FALSE;
+        }
+
+        enc_sample();  // Timer 1 count of the hybrid encoder mode
+        power_tick();  // LED blinking, buzzer and sensor supply timing
+        boot_tick();   // start-up timing
 
         TMR0 = 0xff - 98;  // reload Timer 0 count for 5.0176ms
         TMR0IF = 0;        // clear interruption flag
     }                      // end - Timer 0 handling
 
-    // Interrupt-on-change of PORT B used by the switch
-    // The debounce time is controlled by Timer 0. The change of state of the switch
-    // triggers a time count by Timer 0 from 5 to 10 ms. Every time
-    // there is a change of state of the switch, the debounce time count is
-    // reset.
-    if (RBIE && RBIF) {      // if it's a change of state in Port B
-        char portB = PORTB;  // read Port B, this resets the interruption condition along with RBIF = 0
-        key_read(portB);     // read the switch
-        RBIF = 0;            // reset the interruption flag to be able to receive another interruption
-    }                        // end - I-O-C PORT B treatment
+    // Interrupt-on-change of PORT B
+    // Counts the encoder edges; the switch is sampled by Timer 0 and only
+    // matters here to wake the PIC from power_sleep().
+    if (RBIE && RBIF) {   // if it's a change of state in Port B
+        enc_isr(PORTB);   // reading Port B ends the change condition
+        RBIF = 0;         // reset the interruption flag
+    }                     // end - I-O-C PORT B treatment
+
+    // EEPROM write complete: the black box writes its next byte from the main loop
+    if (EEIE && EEIF) {
+        EEIF = 0;
+        defer_post(EV_EEPROM, 0);
+    }
+
+#ifdef ISR_TIMING_PIN
+    ISR_TIMING_PIN = 0;
+#endif
 }  // end - Handling all interruptions
 
 
@@ -110,23 +208,80 @@ void buzzer_init(void) {
     BUZZER = 0;
 }
 
-// Play a beep
-// To use the BUZZER, the SENSOR POWER must be on.
-void beep() {
-    BUZZER = ON;        // turn on buzzer
-    delay_big_ms(200);  // for 0.2s
-    BUZZER = OFF;       // turn off buzzer
+// LCD ready for the program: no cursor, blank
+void screen_init(void) {
+    lcd_init();
+    lcd_clear();
+    lcd_show_cursor(OFF);
 }
 
-// Display the initial message on the LCD
+// Display the initial message on the LCD, with a beep
 void welcome_message(void) {
     lcd_goto(0);
     lcd_puts("AT06");
     lcd_goto(64);
     lcd_puts("T1-G5");
-    delay_s(2);
+    power_beep(200);
+}
+
+// Start-up steps, see boot.h; the message stays for 2 s after a power-up only
+enum { S_SCREEN, S_WELCOME, S_CLEAR, S_STEPS };
+
+const struct boot_step boot_steps[S_STEPS] = {
+    // init, ready, start_ms, settle_ms, needs, flags
+    {screen_init, NULL, BOOT_LCD_MS, 0, 0, 0},
+    {welcome_message, NULL, 0, 2000, BOOT_NEED(S_SCREEN), BOOT_COLD},
+    {lcd_clear, NULL, 0, 0, BOOT_NEED(S_WELCOME), 0},
+};
+
+// Cart speed at TTC_DUTY_FULL of the profile's unit, mm/s: the top speed of
+// the feed-forward table, or the TTC_MMPS_FULL guess without one
+int full_speed(void) {
+    if (!ffwd_valid()) return TTC_MMPS_FULL;
+    return (int)((long)ffwd_top_speed() * ODO_MM_PER_PULSE_Q8 >> 8);
 }
 
+// Wheel speed in mm/s from the encoder counts of a control tick
+int wheel_mmps(int16_t counts) {
+    return (int)((long)counts * ODO_MM_PER_PULSE_Q8 * (1000 / CONTROL_DT_MS) >> 8);
+}
+
+// Wheel speed in the profile's unit from the encoder counts of a control
+// tick, on the feed-forward table's own scale (ffwd_top_speed() counts/s at
+// FFWD_FULL). Without a table the setpoints are plain duty cycles, which no
+// measured speed matches: 0, so drive_brake() never brakes.
+int wheel_speed(int16_t counts) {
+    if (!ffwd_valid()) return 0;
+    return (int)((long)counts * (1000 / CONTROL_DT_MS) * FFWD_FULL / ffwd_top_speed());
+}
+
+// EV_EEPROM: the last EEPROM byte is written
+void eeprom_written(uint8_t arg) {
+    (void)arg;
+    bbox_isr();
+}
+
+// EV_LINE: the line sensor reading of a Timer 0 tick
+void line_tick(uint8_t tick) {
+    if (line_sampling) curve_sample(sensorLine_read(), tick);  // none left over from a stop
+    line_due = FALSE;
+}
+
+// EV_INPUT: a key press or release
+void key_event(uint8_t arg) {
+    if (INPUT_NUMBER(arg) == KEY && INPUT_TYPE(arg) == INPUT_PRESS && presses < 255) presses++;
+}
+
+// Data byte of the stop record: the most events ever waiting in the defer
+// ring (high nibble) and how many it dropped, at most 15 (low nibble)
+uint8_t defer_summary(void) {
+    uint8_t type;
+    unsigned int dropped = 0;
+
+    for (type = 0; type < EV_TYPES; type++) dropped += defer_overruns(type);
+    if (dropped > 15) dropped = 15;
+    return (uint8_t)(defer_high_water() << 4 | dropped);
+}
 
 void print_lcd(char dir) {
     lcd_goto(0);
@@ -134,88 +289,200 @@ void print_lcd(char dir) {
 }
 
 void main(void) {
+    boot_init();     // reset cause and watchdog period, before anything else
+    key_init();      // switch pin and its interrupt-on-change, for the wake-up
+    defer_init();    // interrupt events for the main loop, before the first one is posted
+    defer_register(EV_EEPROM, eeprom_written);
+    defer_register(EV_LINE, line_tick);
+    defer_register(EV_INPUT, key_event);
+    input_init(EV_INPUT);  // switch debounce, sampled by Timer 0, changes posted as events
+    enc_init();      // encoder inputs and their Port B interruption, see ENC_MODE
+    t0_init();       // initialize Timer 0 for periodic interruption of ~5 ms
+    GIE = 1;         // enable global interruptions: the start-up is timed from here
+
     spi_init();      // initialize SPI for LCD, LED RGB, battery, compass
     led_rgb_init();  // initialize RGB LED
+    battery_init();  // initialize battery reading
     sensor_init();   // initialize sensors
-    lcd_init();      // initialize LCD
-    sensor_init();   // initialize sensors (Note: sensor_init() is called twice)
 
     // local board initializations
-    t0_init();      // initialize Timer 0 for periodic interruption of ~5 ms
     led_init();     // initialize LED for debugging
     buzzer_init();  // initialize buzzer
     pwm_init();     // initialize PWM
-    key_init();     // initialize key (switch)
-
-    GIE = 1;  // enable global interruptions
-
-    delay_s(2);
-    lcd_clear();
-    lcd_show_cursor(OFF);
-    welcome_message();  // display welcome message on LCD
-    beep();             // play a beep
-    lcd_clear();
+    drive_init();   // direction bits forward, both wheels stopped
+    serial_init();  // initialize serial channel for tuning and the black-box dump
+    param_init();   // saved parameters, or the defaults (before bbox_init)
+    ffwd_init();    // motor feed-forward table, see "3 - dc motor"
+    full_mmps = full_speed();  // and the cart speed it makes full scale
+    power_init();   // sensor supply off while the task is stopped
+    bbox_init();    // resume the run log and record the reset cause
+
+    ttc_init();        // no obstacle tracked yet
+    ttc_clearance(param[P_CLEAR]);
+    ttc_full_speed(full_mmps);
+    profile_init();    // both wheels stopped
+    profile_limits(param[P_ACCEL], param[P_DECEL], param[P_JERK]);  // duty/s, duty/s, duty/s^2
+    vbat_init();       // no battery reading yet, duty cycle unscaled
+
+    boot_run(boot_steps, S_STEPS);  // LCD and welcome message, skipped after a warm reset
 
-    sensor_power(ON);  // turn on sensor power
-
-    int duty_max = 550;
     int duty_cycle;
-    int sensor_linha, sensor_distance;
+    int sensor_linha, sensor_distance = 0;
     char keyIn = FALSE;  // key pressed, TRUE = yes
+    char resume;         // a run was cut short by a watchdog or brown-out reset
+    char serialIn;       // character from the serial channel, 255 = none
     int isOn = FALSE;    // robot not activated yet
     char sVar[9];        // string variable
-
+    unsigned int run_ticks = 0;  // control ticks since the task was started
+    unsigned char closest = 0;   // closest proximity reading since the last summary
+    char line_lost = FALSE;
+    char blocked = FALSE;
+    int16_t count_right, count_left;        // encoder counts
+    int16_t last_right = 0, last_left = 0;  // at the previous control tick
+    int speed_right = 0, speed_left = 0;    // measured, in the profile's unit
+    int mmps_right = 0, mmps_left = 0;      // measured, mm/s
+    int speed_mmps;                         // the cart's own, measured
+
+    resume = (boot_cause() & (BOOT_WDT | BOOT_BOR)) && running == TRUE && running_check == (uint8_t)~TRUE;
 
     while (1) {
-        if (isOn == TRUE) {  // when the robot is turned on
+        CLRWDT();  // a pass takes well under the watchdog period
+        defer_dispatch();  // work the interrupt left for the main loop
+
+        if (control_tick) {  // every CONTROL_DT_MS
+            control_tick = 0;
+
+            // wheel speeds from the encoder counts of this control tick
+            count_right = enc_count(ENC_RIGHT);
+            count_left = enc_count(ENC_LEFT);
+            speed_right = wheel_speed(count_right - last_right);
+            speed_left = wheel_speed(count_left - last_left);
+            mmps_right = wheel_mmps(count_right - last_right);
+            mmps_left = wheel_mmps(count_left - last_left);
+            last_right = count_right;
+            last_left = count_left;
+            speed_mmps = (mmps_right + mmps_left) / 2;
+
+            // new proximity reading, once the sensor supply has warmed up
+            if (power_sensors_on()) {
+                sensor_distance = param[P_ADSYNC] ? adcsync_read() : sensorNear_read();  // clear of the PWM edges
+                ttc_update(sensor_distance, speed_mmps);
+            }
+
+            // tape offset, lateral speed and curvature from the times the
+            // line sensor changed; the curvature (antic %) bends the path ahead
+            if (line_sampling) {
+                curve_update(mmps_right, mmps_left);
+                follow_curvature((int)((long)curve_curvature() * param[P_ANTIC] / 100));
+            }
+
+            // about once a second, read the battery (SPI, so not in the ISR)
+            if (vbat_tick()) {
+                vbat_update(battery_read());  // millivolts
+            }
+
+            // move the wheels one step towards the speeds asked for below,
+            // turned into each motor's duty cycle for that speed, and
+            // scaled so the motors see the same voltage whatever the battery charge;
+            // a wheel running well above its speed (a stop, a ramp down) is braked
+            profile_step();
+            if (!drive_brake(1, profile_get(1), speed_right)) drive_set(1, vbat_scale(ffwd_duty(1, profile_get(1))));
+            if (!drive_brake(2, profile_get(2), speed_left)) drive_set(2, vbat_scale(ffwd_duty(2, profile_get(2))));
+
+            // the hybrid encoder mode counts Timer 1 in the direction it is told: the
+            // setpoint's, since a brake pulse slows the wheel but never turns it backwards
+            if (profile_get(1) != 0) enc_direction(ENC_RIGHT, profile_get(1) < 0 ? -1 : 1);
+            if (profile_get(2) != 0) enc_direction(ENC_LEFT, profile_get(2) < 0 ? -1 : 1);
+            if (!boot_output_ms()) {  // time from reset to the first output, on the serial channel
+                boot_output();
+                boot_report();
+            }
+
+            // black box: remember the closest obstacle, log a summary every 10 s
+            if (isOn == TRUE) {
+                run_ticks++;
+                if ((sensor_distance >> 2) > closest) closest = sensor_distance >> 2;
+                if (run_ticks % SUMMARY_TICKS == 0) {
+                    bbox_log(BBOX_SUMMARY, isOn, run_ticks, closest, 0, vbat_millivolts() / 50);
+                    closest = 0;
+                }
+            }
+        }
 
-            sensor_linha = sensorLine_read();  // read the line sensor
-            sensor_distance = sensorNear_read();
+        power_sample();  // switches the sensor supply; samples follow control_tick
 
-            if (sensor_distance >= 500) {
-                duty_cycle = 0;
+        if (isOn == TRUE && power_sensors_on() && !line_sampling) {  // sensors just warmed up:
+            curve_init();                                             // Timer 0 paces the readings
+            line_sampling = TRUE;
+        }
+
+        if (isOn == TRUE && line_sampling && curve_ready()) {  // when the robot is turned on, from the first sample
+
+            sensor_linha = curve_line();  // latest line sensor reading
+
+            // brake so that the cart stops TTC_CLEARANCE_MM before the obstacle
+            duty_cycle = ttc_duty_limit(param[P_DUTY_MAX]);
+            if (duty_cycle == 0) {
                 led_rgb_set_color(RED);
-            } else {
-                duty_cycle = duty_max - sensor_distance;
+                if (!blocked) bbox_log(BBOX_OBSTACLE, isOn, run_ticks, sensor_distance >> 2, 0, 0);
             }
+            blocked = (duty_cycle == 0);
 
-            switch (sensor_linha) {
-            case 2:
-            case 7:
-                pwm_set(1, duty_cycle);
-                pwm_set(2, duty_cycle);    // move forward
+            switch (follow_step(sensor_linha, duty_cycle, param[P_TURN_PCT])) {
+            case FOLLOW_AHEAD:
+                line_lost = FALSE;
+                power_led(POWER_OFF);
                 led_rgb_set_color(GREEN);  // green LED
-                //                    print_lcd('f');
                 break;
-            case 6:
-            case 4:
-                pwm_set(1, duty_cycle);
-                pwm_set(2, 5 * duty_cycle / 10);  // turn left
+            case FOLLOW_LEFT:
+                line_lost = FALSE;
+                power_led(POWER_OFF);
                 led_rgb_set_color(BLUE);
-                //                    print_lcd('e');
                 break;
-            case 3:
-            case 1:
-                pwm_set(1, 5 * duty_cycle / 10);
-                pwm_set(2, duty_cycle);  // turn right
+            case FOLLOW_RIGHT:
+                line_lost = FALSE;
+                power_led(POWER_OFF);
                 led_rgb_set_color(MAGENTA);
-                //                    print_lcd('d');
                 break;
-            default:
-                pwm_set(1, 5 * duty_cycle / 10);
-                pwm_set(2, duty_cycle);  // circular movement to the right
-                LED = ~LED;              // blink LED while not finding the line
+            default:  // circling to the right until the line is found
+                if (!line_lost) bbox_log(BBOX_LINE_LOST, isOn, run_ticks, closest, 0, sensor_linha);
+                line_lost = TRUE;
+                power_led(POWER_BLINK);  // flash the LED while not finding the line
                 led_rgb_set_color(BLACK);
-                //                    print_lcd('E');
                 break;
             }
         }
 
-        keyIn = key_pressed();
+        keyIn = resume;  // a resumed run starts as if the key was pressed
+        resume = FALSE;
+        if (!keyIn && presses) {  // one press per pass, the others wait
+            keyIn = TRUE;
+            presses--;
+        }
         if (keyIn) {       // when the button is pressed
             isOn = !isOn;  // invert the current state
-            pwm_set(1, 0);
-            pwm_set(2, 0);  // circular movement to the right
+            running = (uint8_t)isOn;
+            running_check = (uint8_t)~running;
+            profile_set(1, 0);
+            profile_set(2, 0);  // ramp down to a stop
+            power_activity();
+            if (isOn) {
+                run_ticks = 0;
+                profile_limits(param[P_ACCEL], param[P_DECEL], param[P_JERK]);  // tuned while stopped
+                ttc_init();                        // the sensors were off
+                ttc_clearance(param[P_CLEAR]);
+                ttc_full_speed(full_mmps);
+                follow_init();                     // tape last seen to the right
+                follow_pivot((uint8_t)param[P_PIVOT]);
+                power_sensors(CONTROL_DT_MS);      // supply on for the whole run
+            } else {
+                line_sampling = FALSE;
+                follow_curvature(0);
+                power_sensors(0);                  // sensors and LEDs off while stopped
+                power_led(POWER_OFF);
+                led_rgb_set_color(BLACK);
+            }
+            bbox_log(isOn ? BBOX_START : BBOX_STOP, isOn, run_ticks, closest, 0, isOn ? 0 : defer_summary());
 
             sprintf(sVar, "%d", isOn);
             lcd_goto(0);
@@ -225,5 +492,19 @@ void main(void) {
             lcd_puts("     ");
         }
 
+        // Parameter commands on the serial channel, at any time;
+        // 'D' dumps the black box while stopped
+        serialIn = chkchr();
+        if ((uint8_t)serialIn != 255) power_activity();
+        if (param_input(serialIn) == 'D' && isOn == FALSE) {
+            bbox_dump();
+        }
+
+        // Stopped for a minute without a key press or a command: sleep
+        // until the key is pressed, once the black box is written
+        if (isOn == FALSE && !bbox_busy() && power_sleepy()) {
+            power_sleep();
+        }
+
     }  // end - while
 }  // end - main
@@ -0,0 +1,39 @@
+#include <xc.h>
+
+#include "adcsync.h"
+#include "always.h"
+#include "bits.h"
+
+// Until Timer 2 reaches the sample point; in the next period if it is already past it
+static void wait_phase(uint8_t phase) {
+    while (TMR2 >= phase)
+        ;  // into the next period
+    while (TMR2 < phase)
+        ;
+}
+
+uint16_t adcsync_read(void) {
+    uint8_t adcon0 = ADCON0, adcon1 = ADCON1;
+    uint8_t phase = (uint8_t)(PR2 - ADCSYNC_BEFORE);
+    uint8_t gie;
+    uint16_t value;
+
+    ADCON1bits.ADFM = 1;  // right justified
+    ADCON0bits.ADCS = ADCSYNC_ADCS;
+    ADCON0bits.CHS = ADCSYNC_CHANNEL;
+    ADCON0bits.ADON = 1;
+
+    wait_phase(phase);
+    gie = GIE;
+    gie_off;
+    wait_phase(phase);  // a whole period later, the channel acquired
+    ADCON0bits.GO_nDONE = 1;  // the input is held from here
+    if (gie) gie_on;
+    while (ADCON0bits.GO_nDONE)
+        ;  // 11 TAD, 17.6 us
+
+    value = word_make(ADRESH, ADRESL);
+    ADCON1 = adcon1;
+    ADCON0 = adcon0;
+    return value;
+}
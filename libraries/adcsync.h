@@ -0,0 +1,50 @@
+/*
+
+Proximity sensor sampled in step with the motor PWM
+
+Both motors are switched by CCP1 and CCP2 at the Timer 2 period, 51.2 us
+with PR2 = 255 and a 20 MHz clock: both outputs rise when the period
+starts and each falls at its own duty cycle. Every edge rings on the supply
+and on the GP2D120's signal for a few microseconds. sensorNear_read()
+starts a conversion whenever it is called, so now and then the sample is
+taken on an edge and the reading is off by tens of counts, enough to cross
+a stop threshold or to upset the time-to-collision filter.
+
+adcsync_read() starts the conversion at the same point of every period
+instead, ADCSYNC_BEFORE counts of Timer 2 before it ends: the outputs have
+been steady since they fell (for any duty cycle below PR2 - ADCSYNC_BEFORE)
+and have not risen yet. The ADC holds its input from the moment GO is set,
+so only that moment has to be quiet.
+
+The PIC16F886 starts a conversion in hardware only from the CCP2 special
+event trigger, which needs CCP2 in compare mode and resets Timer 1; here
+CCP2 drives a motor and Timer 1 may count an encoder (encoder.h). The start
+is timed by polling TMR2 instead: first a whole period with the channel
+selected, for the acquisition, then the sample point with interrupts off,
+at most one period (51 us). A reading takes about 130 us in all.
+ADCON0 and ADCON1 are restored, so sensorNear_read() and the line sensors
+work as before.
+
+ADCSYNC_CHANNEL must be the analog input of the proximity sensor on the
+board, the one sensorNear_read() reads; the default is a placeholder.
+tools/adcnoise.c estimates the spread of both kinds of reading.
+
+Example C:
+int distance = adcsync_read();  // 0..1023, like sensorNear_read()
+
+*/
+
+#ifndef ADCSYNC_H
+#define ADCSYNC_H
+
+#include <stdint.h>
+
+#ifndef ADCSYNC_CHANNEL
+#define ADCSYNC_CHANNEL 0  // ANx of the GP2D120, check against the board
+#endif
+#define ADCSYNC_BEFORE 16  // Timer 2 counts before the period ends (3.2 us)
+#define ADCSYNC_ADCS 2     // ADC clock Fosc/32, 1.6 us at 20 MHz
+
+uint16_t adcsync_read(void);
+
+#endif
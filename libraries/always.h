@@ -33,8 +33,8 @@ x = 0b001;
 bits_on(x, 0b100)  // now x = 0b101
 */
 
-#define bits_on(var, mask) var |= mask
-#define bits_off(var, mask) var &= ~0 ^ mask
+#define bits_on(var, mask) ((var) |= (mask))
+#define bits_off(var, mask) ((var) &= ~0 ^ (mask))  // parenthesized, see bits.h for typed access
 
 // Defines
 #define INPUT 1  // port directions, ie: TRISA0=INPUT;
@@ -79,8 +79,8 @@ y = lobyte(x);	    // now y = 0x34
 lobyte(x) = 0xaa;     // will not work :( - use pointers
 */
 
-#define hibyte(x) (unsigned char)(x >> 8)
-#define lobyte(x) (unsigned char)(x & 0xFF)
+#define hibyte(x) ((unsigned char)((x) >> 8))
+#define lobyte(x) ((unsigned char)((x) & 0xFF))
 
 /*
 given variable of any type (char, uchar, int, uint, long) it modifies
@@ -0,0 +1,89 @@
+/*
+
+Register and bit-field access
+
+Typed replacement for the bits_on/bits_off, byteN and testbit/setbit/clrbit
+macros. XC8 is a C compiler, so the "descriptors" are preprocessor tuples
+instead of C++ constexpr objects: a pin or field is declared once as
+(register, position[, width]) and every access goes through the same macros.
+A misspelled descriptor is a compile error, not a silently wrong mask.
+
+With a constant position, XC8 compiles the single-bit forms to one
+bsf / bcf / btfsc / btfss instruction on an SFR. The header only depends on
+<stdint.h>, so the same code compiles with gcc for host tests, where the
+"registers" are plain uint8_t variables.
+
+Example C:
+#define LED_PIN PORTB, 5          // one bit
+#define ENC1_AB PORTB, 3, 2       // two bits starting at RB3
+
+pin_set(LED_PIN);                 // bsf PORTB, 5
+pin_clr(LED_PIN);                 // bcf PORTB, 5
+if (pin_test(LED_PIN)) { ... }    // btfss PORTB, 5
+state = field_get(ENC1_AB);       // (PORTB >> 3) & 0b11
+field_put(ENC1_AB, 0b10);         // read-modify-write of bits 3..4 only
+
+Hi/lo byte access is done with shifts and masks, never with pointer casts or
+unions, so it is correct for any byte order and free of aliasing problems.
+XC8 reduces these to single byte moves.
+
+unsigned int w = 0x1234;
+word_hi(w);                       // 0x12
+word_set_lo(w, 0xAA);             // now w = 0x12AA
+
+*/
+
+#ifndef BITS_H
+#define BITS_H
+
+#include <stdint.h>
+
+// Plain variable + bit number
+#define BIT(n) ((uint8_t)(1u << (n)))
+#define MASK(pos, width) ((uint8_t)(((1u << (width)) - 1u) << (pos)))
+
+#define bit_set(var, n) ((var) |= BIT(n))
+#define bit_clr(var, n) ((var) &= (uint8_t)~BIT(n))
+#define bit_test(var, n) (((var) & BIT(n)) != 0)
+#define bit_toggle(var, n) ((var) ^= BIT(n))
+#define bit_write(var, n, value) \
+    do {                         \
+        if (value)               \
+            bit_set(var, n);     \
+        else                     \
+            bit_clr(var, n);     \
+    } while (0)
+
+// Descriptor forms: expand the (register, position[, width]) tuple first
+#define pin_set(...) bit_set_(__VA_ARGS__)
+#define pin_clr(...) bit_clr_(__VA_ARGS__)
+#define pin_test(...) bit_test_(__VA_ARGS__)
+#define pin_toggle(...) bit_toggle_(__VA_ARGS__)
+#define pin_write(...) bit_write_(__VA_ARGS__)
+
+#define field_get(...) field_get_(__VA_ARGS__)
+#define field_put(...) field_put_(__VA_ARGS__)
+#define field_mask(...) field_mask_(__VA_ARGS__)
+
+#define bit_set_(reg, n) bit_set(reg, n)
+#define bit_clr_(reg, n) bit_clr(reg, n)
+#define bit_test_(reg, n) bit_test(reg, n)
+#define bit_toggle_(reg, n) bit_toggle(reg, n)
+#define bit_write_(reg, n, value) bit_write(reg, n, value)
+
+#define field_mask_(reg, pos, width) MASK(pos, width)
+#define field_get_(reg, pos, width) ((uint8_t)(((reg) >> (pos)) & MASK(0, width)))
+#define field_put_(reg, pos, width, value) \
+    ((reg) = (uint8_t)(((reg) & (uint8_t)~MASK(pos, width)) | (((uint8_t)(value) << (pos)) & MASK(pos, width))))
+
+// 16-bit words
+#define word_hi(w) ((uint8_t)((uint16_t)(w) >> 8))
+#define word_lo(w) ((uint8_t)((uint16_t)(w) & 0xFFu))
+#define word_make(hi, lo) ((uint16_t)(((uint16_t)(uint8_t)(hi) << 8) | (uint8_t)(lo)))
+#define word_set_hi(w, b) ((w) = word_make(b, word_lo(w)))
+#define word_set_lo(w, b) ((w) = word_make(word_hi(w), b))
+
+// 32-bit words, byte 0 is the least significant
+#define dword_byte(d, n) ((uint8_t)((uint32_t)(d) >> (8 * (n))))
+
+#endif
@@ -0,0 +1,159 @@
+#include <xc.h>
+
+#include "always.h"
+#include "blackbox.h"
+#include "serial.h"
+
+#define SEQ_ERASED 0xFF
+#define SEQ_NEXT(s) ((uint8_t)((s) >= 254 ? 0 : (s) + 1))
+
+static uint8_t queue[BBOX_QUEUE][BBOX_RECORD];
+static volatile uint8_t q_head;  // next record to fill, main loop only
+static volatile uint8_t q_tail;  // record being written, ISR only
+static volatile uint8_t q_count;
+static volatile uint8_t byte_index;
+
+static uint8_t next_slot;  // where the next record goes
+static uint8_t next_seq;
+static volatile uint8_t write_slot;  // slot of the record being written
+static uint8_t dropped;
+
+static uint8_t slot_address(uint8_t slot) {
+    return (uint8_t)(BBOX_EE_START + slot * BBOX_RECORD);
+}
+
+static uint8_t checksum(const uint8_t *record) {
+    uint8_t sum = 0;
+    uint8_t i;
+
+    for (i = 0; i < BBOX_RECORD - 1; i++) sum += record[i];
+    return sum ^ 0x5A;
+}
+
+static char slot_valid(uint8_t slot, uint8_t *seq) {
+    uint8_t record[BBOX_RECORD];
+    uint8_t addr = slot_address(slot);
+    uint8_t i;
+
+    for (i = 0; i < BBOX_RECORD; i++) record[i] = EEPROM_READ(addr + i);
+    *seq = record[0];
+    return record[0] != SEQ_ERASED && record[BBOX_RECORD - 1] == checksum(record);
+}
+
+// Starts the write of one byte; interrupts must be off
+static void start_write(uint8_t addr, uint8_t data) {
+    EEADR = addr;
+    EEDAT = data;
+    EECON1bits.EEPGD = 0;  // data memory
+    EECON1bits.WREN = 1;
+    EECON2 = 0x55;  // required sequence
+    EECON2 = 0xAA;
+    EECON1bits.WR = 1;
+    EECON1bits.WREN = 0;  // the write goes on, further writes are blocked
+}
+
+void bbox_init(void) {
+    uint8_t slot, seq, next;
+
+    q_head = q_tail = q_count = 0;
+    byte_index = 0;
+    dropped = 0;
+
+    // Newest record: a valid slot whose successor does not continue the sequence
+    next_slot = 0;
+    next_seq = 0;
+    for (slot = 0; slot < BBOX_SLOTS; slot++) {
+        if (!slot_valid(slot, &seq)) continue;
+        if (slot_valid((uint8_t)((slot + 1) % BBOX_SLOTS), &next) && next == SEQ_NEXT(seq)) continue;
+        next_slot = (uint8_t)((slot + 1) % BBOX_SLOTS);
+        next_seq = SEQ_NEXT(seq);
+        break;
+    }
+
+    EEIF = 0;
+    EEIE = 1;  // EEPROM write complete interrupt
+    PEIE = 1;  // peripheral interrupts
+
+    bbox_log(BBOX_RESET, 0, 0, 0, 0, boot_cause());
+}
+
+void bbox_log(uint8_t type, uint8_t state, uint16_t tick, uint8_t closest, uint8_t lap, uint8_t data) {
+    uint8_t *record;
+    uint8_t gie = GIE;
+
+    if (q_count >= BBOX_QUEUE) {  // EEPROM still busy with older records
+        dropped++;
+        return;
+    }
+
+    record = queue[q_head];
+    record[0] = next_seq;
+    record[1] = (uint8_t)(type | (state & 0x0F));
+    record[2] = (uint8_t)tick;
+    record[3] = (uint8_t)(tick >> 8);
+    record[4] = closest;
+    record[5] = lap;
+    record[6] = data;
+    record[7] = checksum(record);
+    next_seq = SEQ_NEXT(next_seq);
+    q_head = (uint8_t)((q_head + 1) % BBOX_QUEUE);
+
+    gie_off;
+    if (q_count++ == 0) {  // idle: start the first byte, EEIF does the rest
+        write_slot = next_slot;
+        byte_index = 0;
+        start_write(slot_address(write_slot), queue[q_tail][0]);
+    }
+    next_slot = (uint8_t)((next_slot + 1) % BBOX_SLOTS);
+    if (gie) gie_on;
+}
+
+void bbox_isr(void) {
+    uint8_t gie = GIE;
+
+    gie_off;
+    // WR: our byte is still being written, or this EEIF was not ours
+    if (q_count != 0 && !EECON1bits.WR) {
+        if (++byte_index >= BBOX_RECORD) {  // record complete
+            byte_index = 0;
+            q_tail = (uint8_t)((q_tail + 1) % BBOX_QUEUE);
+            write_slot = (uint8_t)((write_slot + 1) % BBOX_SLOTS);
+            q_count--;
+        }
+        if (q_count != 0) start_write((uint8_t)(slot_address(write_slot) + byte_index), queue[q_tail][byte_index]);
+    }
+    if (gie) gie_on;
+}
+
+char bbox_busy(void) {
+    return q_count != 0;
+}
+
+uint8_t bbox_dropped(void) {
+    return dropped;
+}
+
+void bbox_dump(void) {
+    uint8_t slot, i, n, seq, addr;
+    uint8_t count = 0;
+
+    while (bbox_busy()) bbox_isr();  // EEADR is in use until the queue drains
+
+    for (slot = 0; slot < BBOX_SLOTS; slot++) {
+        if (slot_valid(slot, &seq)) count++;
+    }
+
+    putch('B');
+    putch('B');
+    putch(count);
+
+    // Oldest first: the slot after the newest one
+    slot = next_slot;
+    for (n = 0; n < BBOX_SLOTS; n++) {
+        if (slot_valid(slot, &seq)) {
+            addr = slot_address(slot);
+            for (i = 0; i < BBOX_RECORD; i++) putch(EEPROM_READ(addr + i));
+        }
+        slot = (uint8_t)((slot + 1) % BBOX_SLOTS);
+    }
+}
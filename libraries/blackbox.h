@@ -0,0 +1,75 @@
+/*
+
+EEPROM black-box run log
+
+Keeps the last BBOX_SLOTS records of a run in the data EEPROM, so they
+survive a reset or power-off and can be dumped over the serial channel
+afterwards.
+
+Record (8 bytes):
+    0  seq      sequence number 0..254, 255 = erased
+    1  type     high nibble: BBOX_RESET, BBOX_START, ...; low nibble: state
+    2  tick     control ticks since the run started, low byte
+    3           high byte
+    4  closest  closest proximity reading since the last record (ADC >> 2)
+    5  lap      lap counter
+    6  data     type specific; reset cause bits for BBOX_RESET
+    7  check    sum of bytes 0..6 xor 0x5A
+
+The records form a ring between BBOX_EE_START and BBOX_EE_END. At start-up
+the newest record is found from the break in the sequence numbers, and
+writing goes on after it, so every cell is worn the same.
+
+Writing a byte of EEPROM takes about 4 ms. bbox_log() only copies the
+record to a RAM queue; the EEPROM interrupt (EEIF) writes one byte after the
+other, so the control loop never waits. The ISR must call bbox_isr():
+
+    if (EEIE && EEIF) {
+        EEIF = 0;
+        bbox_isr();
+    }
+
+or post the event for the main loop to call it (defer.h); bbox_isr() only
+goes on when the last byte is written, so a late or extra call is harmless.
+Nothing else may use EEADR while a write is in progress (bbox_busy()).
+The reset cause comes from boot_cause(), so boot_init() must run first.
+
+bbox_dump() sends "BB", the number of records and then the records, oldest
+first, through putch(). tools/bbox_decode.py turns that into a table.
+
+*/
+
+#ifndef BLACKBOX_H
+#define BLACKBOX_H
+
+#include <stdint.h>
+
+#include "boot.h"
+
+#define BBOX_EE_START 0x80  // EEPROM bytes 0x80..0xFF, 16 records
+#define BBOX_EE_END 0x100
+#define BBOX_RECORD 8
+#define BBOX_SLOTS ((BBOX_EE_END - BBOX_EE_START) / BBOX_RECORD)
+#define BBOX_QUEUE 2        // records waiting in RAM to be written
+
+// Record types (high nibble of byte 1)
+#define BBOX_RESET 0x10     // data = BBOX_POR | BBOX_BOR | BBOX_WDT
+#define BBOX_START 0x20
+#define BBOX_STOP 0x30       // data = most events waiting << 4 | events dropped, defer.h
+#define BBOX_SUMMARY 0x40    // data = battery voltage in 50 mV steps
+#define BBOX_OBSTACLE 0x50
+#define BBOX_LINE_LOST 0x60  // data = line sensor pattern
+
+// Reset causes
+#define BBOX_POR BOOT_POR
+#define BBOX_BOR BOOT_BOR
+#define BBOX_WDT BOOT_WDT
+
+void bbox_init(void);
+void bbox_log(uint8_t type, uint8_t state, uint16_t tick, uint8_t closest, uint8_t lap, uint8_t data);
+void bbox_isr(void);
+char bbox_busy(void);
+uint8_t bbox_dropped(void);
+void bbox_dump(void);
+
+#endif
@@ -0,0 +1,109 @@
+#include <xc.h>
+
+#include "always.h"
+#include "boot.h"
+#include "serial.h"
+
+static uint8_t cause;
+static volatile uint16_t now;  // ms since reset
+static uint16_t ready_ms;
+static uint16_t output_ms;
+
+void boot_init(void) {
+    // Reset cause, then re-arm the flags for the next reset
+    cause = 0;
+    if (!PCONbits.nPOR) {
+        cause |= BOOT_POR;
+    } else if (!PCONbits.nBOR) {
+        cause |= BOOT_BOR;
+    }
+    if (!STATUSbits.nTO) cause |= BOOT_WDT;
+    PCONbits.nPOR = 1;
+    PCONbits.nBOR = 1;
+
+    now = 0;
+    ready_ms = 0;
+    output_ms = 0;
+    WDTCONbits.WDTPS = BOOT_WDT_PS;
+    CLRWDT();
+}
+
+void boot_tick(void) {
+    if (now <= 0xFFFF - BOOT_TICK_MS) now += BOOT_TICK_MS;
+}
+
+uint16_t boot_ms(void) {
+    uint8_t gie = GIE;
+    uint16_t ms;
+
+    gie_off;  // both bytes from the same tick
+    ms = now;
+    if (gie) gie_on;
+    return ms;
+}
+
+void boot_run(const struct boot_step *steps, uint8_t count) {
+    uint16_t started_at[BOOT_MAX_STEPS];
+    uint8_t started = 0, ready = 0, all, bit, i;
+    const struct boot_step *s;
+
+    if (count > BOOT_MAX_STEPS) count = BOOT_MAX_STEPS;
+    all = (uint8_t)((1 << count) - 1);
+
+    while (ready != all) {
+        CLRWDT();
+        for (i = 0, bit = 1; i < count; i++, bit <<= 1) {
+            s = &steps[i];
+            if (ready & bit) continue;
+            if (!(started & bit)) {
+                if ((ready & s->needs) != s->needs) continue;
+                if ((s->flags & BOOT_COLD) && boot_warm()) {  // skipped, in its turn
+                    ready |= bit;
+                    continue;
+                }
+                if (boot_ms() < s->start_ms) continue;
+                if (s->init) s->init();
+                started |= bit;
+                started_at[i] = boot_ms();
+            }
+            if ((uint16_t)(boot_ms() - started_at[i]) >= s->settle_ms && (!s->ready || s->ready())) ready |= bit;
+        }
+    }
+    ready_ms = boot_ms();
+}
+
+uint8_t boot_cause(void) {
+    return cause;
+}
+
+char boot_warm(void) {
+    return !(cause & BOOT_POR);
+}
+
+uint16_t boot_ready_ms(void) {
+    return ready_ms;
+}
+
+void boot_output(void) {
+    if (!output_ms) output_ms = boot_ms() ? boot_ms() : 1;
+}
+
+uint16_t boot_output_ms(void) {
+    return output_ms;
+}
+
+void boot_report(void) {
+    const char *s = boot_warm() ? "boot warm " : "boot cold ";
+    char digits[5];
+    uint16_t ms = output_ms;
+    uint8_t i = 0;
+
+    while (*s) putch(*s++);
+    do {
+        digits[i++] = (char)('0' + ms % 10);
+        ms /= 10;
+    } while (ms);
+    while (i) putch(digits[--i]);
+    s = " ms\n";
+    while (*s) putch(*s++);
+}
@@ -0,0 +1,101 @@
+/*
+
+Start-up as a table of steps run side by side off the Timer 0 tick
+
+Each peripheral's initialization is a step that declares what it waits for:
+
+    init       called once, when the step may start (NULL = nothing to call)
+    ready      polled after init until it returns TRUE (NULL = no condition);
+               may finish the job, e.g. enable the PWM outputs once Timer 2
+               has rolled over
+    start_ms   earliest start, in ms since reset (the LCD module's power-up)
+    settle_ms  time from init until the step counts as ready (sensor warm-up,
+               how long the splash screen stays)
+    needs      steps that must be ready first, bit i = step i
+    flags      BOOT_COLD: only after a power-on reset
+
+boot_run() goes round the table until every step is ready, starting each one
+as soon as its own conditions hold, so the waits overlap instead of adding
+up. Steps are numbered by their place in the table, at most BOOT_MAX_STEPS.
+
+After a brown-out, watchdog or MCLR reset the cart is already set up and
+someone may be waiting for it, so the BOOT_COLD steps (splash screen, beep)
+are skipped and the program is running again in tens of milliseconds. A
+skipped step still counts as ready only once the steps it needs are, so
+the steps after it keep their order.
+
+boot_init() must be the first call in main(): it records the reset cause
+(later calls of CLRWDT() would hide a watchdog reset), sets the watchdog
+period to BOOT_WDT_PS and clears it. Timer 0 and GIE come right after, so
+the time is counted from reset; the interrupt then runs while the other
+modules are initialized, which is fine for those whose state starts at 0.
+boot_run() clears the watchdog while it waits; the program's main loop must
+do it every pass.
+
+Time to first control output is measured: the program calls boot_output()
+where it first drives the motors (or shows its first result), and
+boot_report() prints "boot cold 2041 ms" or "boot warm 46 ms".
+
+Example C:
+enum { S_LCD, S_SPLASH, S_CLEAR };
+static const struct boot_step steps[] = {
+    // init, ready, start_ms, settle_ms, needs, flags
+    {lcd_init, NULL, BOOT_LCD_MS, 0, 0, 0},
+    {splash, NULL, 0, 2000, BOOT_NEED(S_LCD), BOOT_COLD},
+    {lcd_clear, NULL, 0, 0, BOOT_NEED(S_SPLASH), 0},
+};
+
+boot_init();
+t0_init();     // boot_tick() in the Timer 0 interrupt
+GIE = 1;
+boot_run(steps, sizeof steps / sizeof steps[0]);
+while (1) {
+    CLRWDT();
+    ...
+    pwm_set(1, duty);
+    boot_output();
+}
+
+*/
+
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+
+#define BOOT_TICK_MS 5      // boot_tick() period
+#define BOOT_MAX_STEPS 8
+#define BOOT_LCD_MS 40      // LCD module power-up before its first command
+#define BOOT_WDT_PS 0b1010  // watchdog prescaler 1:32768 of 31 kHz, about 1 s
+
+// Reset causes, the same bits as the black box's
+#define BOOT_POR 0x01
+#define BOOT_BOR 0x02
+#define BOOT_WDT 0x04
+
+#define BOOT_COLD 0x01  // step flag: power-on reset only
+
+#define BOOT_NEED(step) (1 << (step))
+
+struct boot_step {
+    void (*init)(void);
+    char (*ready)(void);
+    uint16_t start_ms;
+    uint16_t settle_ms;
+    uint8_t needs;
+    uint8_t flags;
+};
+
+void boot_init(void);
+void boot_tick(void);  // from the Timer 0 interrupt
+void boot_run(const struct boot_step *steps, uint8_t count);
+
+uint8_t boot_cause(void);  // BOOT_POR, BOOT_BOR, BOOT_WDT; 0 = MCLR
+char boot_warm(void);      // TRUE unless power-on reset
+uint16_t boot_ms(void);    // since reset, saturating
+uint16_t boot_ready_ms(void);  // when boot_run() returned
+void boot_output(void);
+uint16_t boot_output_ms(void);  // time to first output, 0 until boot_output()
+void boot_report(void);
+
+#endif
@@ -0,0 +1,129 @@
+#include "always.h"
+#include "bits.h"
+#include "convoy.h"
+#include "ttc.h"  // TTC_NONE, TTC_RANGE_MM
+
+#if CONVOY_GAP_MAX_MM >= TTC_RANGE_MM
+#error "CONVOY_GAP_MAX_MM must be inside the proximity sensor's range"
+#endif
+#if CONVOY_TIMEOUT_MS <= CONVOY_PERIOD_MS
+#error "CONVOY_TIMEOUT_MS must allow for at least one broadcast"
+#endif
+
+// Lead
+static int16_t last_speed;
+static int32_t accel4;  // filtered acceleration, mm/s^2 * 4
+static uint8_t timer;   // ms since the last broadcast
+static uint8_t tx_seq;
+
+// Follower
+static char heard;            // a broadcast arrived since convoy_init()
+static uint8_t rx_seq;
+static int16_t lead_speed;    // mm/s
+static int16_t lead_accel;    // mm/s^2
+static uint16_t age;          // ms since the last broadcast, saturating
+static int16_t gap_error;
+static uint16_t received, missed;
+
+static void put16(uint8_t *p, int16_t v) {
+    p[0] = word_lo(v);
+    p[1] = word_hi(v);
+}
+
+static int16_t get16(const uint8_t *p) {
+    return (int16_t)word_make(p[1], p[0]);
+}
+
+uint8_t convoy_lead(int16_t speed_mmps, uint8_t *data) {
+    int32_t a = ((int32_t)speed_mmps - last_speed) * (1000 / CONVOY_DT_MS);
+
+    last_speed = speed_mmps;
+    accel4 += a - accel4 / 4;  // about 4 control ticks
+
+    timer += CONVOY_DT_MS;
+    if (timer < CONVOY_PERIOD_MS) return 0;
+    timer = 0;
+
+    a = accel4 / 4;
+    if (a > 32767) a = 32767;
+    if (a < -32767) a = -32767;
+    data[0] = CONVOY_TAG;
+    data[1] = tx_seq++;
+    put16(data + 2, speed_mmps);
+    put16(data + 4, (int16_t)a);
+    return CONVOY_LEN;
+}
+
+void convoy_init(void) {
+    last_speed = 0;
+    accel4 = 0;
+    timer = 0;
+    heard = FALSE;
+    age = CONVOY_TIMEOUT_MS;
+    gap_error = 0;
+    received = missed = 0;
+}
+
+void convoy_receive(const uint8_t *data, uint8_t len) {
+    uint8_t lost;
+
+    if (len != CONVOY_LEN || data[0] != CONVOY_TAG) return;
+    if (heard) {
+        lost = (uint8_t)(data[1] - rx_seq - 1);
+        if (lost >= 128) return;  // older than the last one, the link delivered it late
+        missed = missed + lost < missed ? 0xFFFF : missed + lost;
+    }
+    heard = TRUE;
+    rx_seq = data[1];
+    lead_speed = get16(data + 2);
+    lead_accel = get16(data + 4);
+    age = 0;
+    if (received < 0xFFFF) received++;
+}
+
+int16_t convoy_follow(int16_t gap_mm, int16_t closing_mmps, int16_t speed_mmps) {
+    int32_t lead, want, v;
+    char linked;
+
+    if (age < CONVOY_TIMEOUT_MS) age += CONVOY_DT_MS;
+    linked = convoy_linked();
+
+    if (linked)
+        lead = lead_speed + (int32_t)lead_accel * (age + CONVOY_AHEAD_MS) / 1000;
+    else if (gap_mm != TTC_NONE)
+        lead = (int32_t)speed_mmps - closing_mmps;
+    else {
+        gap_error = 0;
+        return CONVOY_NONE;
+    }
+
+    if (gap_mm == TTC_NONE) {  // linked, the lead out of range
+        gap_error = 0;
+        v = lead + CONVOY_CATCHUP_MMPS;
+    } else {
+        want = CONVOY_GAP_MM + (int32_t)(speed_mmps > 0 ? speed_mmps : 0) *
+                                   (linked ? CONVOY_HEADWAY_MS : CONVOY_HEADWAY_PROX_MS) / 1000;
+        if (want > CONVOY_GAP_MAX_MM) want = CONVOY_GAP_MAX_MM;
+        gap_error = (int16_t)(gap_mm - want);
+        v = lead + (((int32_t)gap_error * CONVOY_KP_Q8) >> 8);
+    }
+    if (v < 0) v = 0;
+    if (v > CONVOY_NONE - 1) v = CONVOY_NONE - 1;
+    return (int16_t)v;
+}
+
+char convoy_linked(void) {
+    return heard && age < CONVOY_TIMEOUT_MS;
+}
+
+int16_t convoy_gap_error(void) {
+    return gap_error;
+}
+
+uint16_t convoy_received(void) {
+    return received;
+}
+
+uint16_t convoy_missed(void) {
+    return missed;
+}
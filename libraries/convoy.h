@@ -0,0 +1,79 @@
+/*
+
+Two-cart convoy: the lead's speed over the link, the follower's gap control
+
+The lead calls convoy_lead() every control tick with its measured speed; every
+CONVOY_PERIOD_MS it fills a broadcast with that speed, its filtered
+acceleration and a sequence number, to be sent with link_send() to
+LINK_BROADCAST. The follower hands every frame it receives to
+convoy_receive() and calls convoy_follow() every control tick with the gap
+and closing speed of the proximity filter (ttc.h) and its own speed. The
+result is the speed it should not exceed, mm/s:
+
+    lead speed   from the last broadcast, moved on by its acceleration for
+                 the packet's age plus CONVOY_AHEAD_MS (the follower's lag);
+                 without broadcasts, own speed - closing speed
+    gap wanted   CONVOY_GAP_MM + own speed * headway, at most
+                 CONVOY_GAP_MAX_MM so the sensor still sees the lead
+    speed        lead speed + CONVOY_KP_Q8 * (gap - gap wanted)
+
+The lead's speed is known before the gap has changed, so with the link the
+follower keeps a short headway (CONVOY_HEADWAY_MS) and speeds up and brakes
+with the lead instead of after it. After CONVOY_TIMEOUT_MS without a
+broadcast the follower falls back to the proximity sensor alone, with the
+longer CONVOY_HEADWAY_PROX_MS, until broadcasts come back. Linked but with
+the lead out of the sensor's range, it closes in at CONVOY_CATCHUP_MMPS
+above the lead; with neither, there is no limit (CONVOY_NONE) and the
+time-to-collision limit alone applies.
+
+Everything is integer, and the module builds on the host for
+tools/convoysim.c. With the link it takes about 140 bytes of RAM, more than
+the autonomous task has to spare, so no activity builds it in for now.
+
+Example C:
+// lead, every control tick
+if ((len = convoy_lead(speed_mmps, data)) != 0) link_send(&link, LINK_BROADCAST, data, len);
+
+// follower
+if (link_recv(&link, &src, data) > 0) convoy_receive(data, len);
+if (control_tick) {
+    ttc_update(sensorNear_read(), speed_mmps);
+    limit = convoy_follow(ttc_distance(), ttc_closing(), speed_mmps);
+}
+
+*/
+
+#ifndef CONVOY_H
+#define CONVOY_H
+
+#include <stdint.h>
+
+#define CONVOY_DT_MS 40              // convoy_lead() and convoy_follow() period
+#define CONVOY_PERIOD_MS 80          // between two broadcasts of the lead
+#define CONVOY_TIMEOUT_MS 300        // no broadcast this long: proximity only
+#define CONVOY_GAP_MM 80             // gap kept when stopped
+#define CONVOY_HEADWAY_MS 200        // gap per speed, with broadcasts
+#define CONVOY_HEADWAY_PROX_MS 500   // gap per speed, proximity only
+#define CONVOY_GAP_MAX_MM 250        // inside the proximity sensor's range
+#define CONVOY_KP_Q8 384             // mm/s per mm of gap error, Q8 (1.5/s)
+#define CONVOY_AHEAD_MS 120          // lead's acceleration applied this much ahead
+#define CONVOY_CATCHUP_MMPS 150      // linked, lead out of range: this much faster
+
+#define CONVOY_TAG 'V'  // first payload byte of a broadcast
+#define CONVOY_LEN 6    // tag, sequence, speed, acceleration
+#define CONVOY_NONE 0x7FFF
+
+void convoy_init(void);  // at the start of a run, either cart
+
+// Lead
+uint8_t convoy_lead(int16_t speed_mmps, uint8_t *data);  // length to broadcast, 0 = not yet
+
+// Follower
+void convoy_receive(const uint8_t *data, uint8_t len);
+int16_t convoy_follow(int16_t gap_mm, int16_t closing_mmps, int16_t speed_mmps);
+char convoy_linked(void);           // broadcasts are arriving
+int16_t convoy_gap_error(void);     // mm, + = too far behind; 0 if the gap is unknown
+uint16_t convoy_received(void);     // broadcasts taken
+uint16_t convoy_missed(void);       // broadcasts lost, from the sequence numbers
+
+#endif
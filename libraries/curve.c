@@ -0,0 +1,190 @@
+#include "always.h"
+#include "curve.h"
+#include "odometry.h"  // ODO_TRACK_MM
+
+// Positions in 1/16 mm
+#define Q 16
+#define B1 ((CURVE_PITCH_MM * 2 - CURVE_TAPE_MM) * Q / 2)  // level 0/1 crossing
+#define B2 (CURVE_TAPE_MM * Q / 2)                         // level 1/2 crossing
+#define B3 ((CURVE_PITCH_MM * 2 + CURVE_TAPE_MM) * Q / 2)  // level 2 lost
+#define NO_LEVEL 0x7F
+
+#if CURVE_TAPE_MM <= CURVE_PITCH_MM
+#error "CURVE_TAPE_MM must be wider than CURVE_PITCH_MM"
+#endif
+
+static uint8_t last_line;
+static uint16_t now;        // tick of the last sample
+static char sampled;        // curve_sample() ran since curve_init()
+static int8_t level;        // band of the tape, NO_LEVEL = unknown
+static int16_t edge_y;      // position of the last crossing
+static uint16_t edge_tick;
+static uint8_t edges;       // crossings since the tape was found, up to 2
+static int16_t lateral;     // mm/s from the last two crossings
+static int16_t heading;     // mrad
+static int32_t curvature;   // 1000/m
+static char have_heading;   // heading from the previous update
+static uint16_t update_tick;
+static int16_t offset_q;    // 1/16 mm
+static int16_t lateral_now; // lateral, limited by the time since the last crossing
+
+void curve_init(void) {
+    last_line = 0;
+    now = 0;
+    sampled = FALSE;
+    level = NO_LEVEL;
+    edges = 0;
+    have_heading = FALSE;
+    lateral = lateral_now = heading = 0;
+    curvature = 0;
+    offset_q = 0;
+}
+
+uint8_t curve_line(void) {
+    return last_line;
+}
+
+char curve_ready(void) {
+    return sampled;
+}
+
+static int8_t level_of(uint8_t line) {
+    switch (line) {
+    case 1: return -2;
+    case 3: return -1;
+    case 2: return 0;
+    case 6: return 1;
+    case 4: return 2;
+    default: return NO_LEVEL;  // 111 crossing, 000 and 101 lost
+    }
+}
+
+// Crossing between level k - 1 and k
+static int16_t edge_of(int8_t k) {
+    switch (k) {
+    case -1: return -B2;
+    case 0: return -B1;
+    case 1: return B1;
+    default: return B2;  // 2
+    }
+}
+
+// Band of level k
+static int16_t low_of(int8_t k) {
+    return k == -2 ? -B3 : edge_of(k);
+}
+
+static int16_t high_of(int8_t k) {
+    return k == 2 ? B3 : edge_of(k + 1);
+}
+
+static int16_t mm_per_s(int16_t dy_q, uint16_t ticks) {
+    return (int16_t)((int32_t)dy_q * (1000 / CURVE_TICK_MS) / ((int32_t)Q * ticks));
+}
+
+static void crossing(uint8_t line, uint16_t tick) {
+    int8_t k = level_of(line);
+    int16_t y;
+
+    if (k == NO_LEVEL) {
+        if (line != 7) {  // lost; across a crossing the estimate goes on
+            level = NO_LEVEL;
+            edges = 0;
+            lateral = 0;
+        }
+        return;
+    }
+    if (level == NO_LEVEL) {  // found again: a band, no crossing yet
+        level = k;
+        edge_y = (int16_t)((low_of(k) + high_of(k)) / 2);
+        edge_tick = tick;
+        return;
+    }
+    if (k == level) return;
+    y = k > level ? edge_of(k) : edge_of(k + 1);
+    if (edges) lateral = tick != edge_tick ? mm_per_s(y - edge_y, (uint16_t)(tick - edge_tick)) : 0;
+    if (edges < 2) edges++;
+    level = k;
+    edge_y = y;
+    edge_tick = tick;
+}
+
+void curve_sample(uint8_t line, uint8_t tick) {
+    if (sampled) now += (uint8_t)(tick - (uint8_t)now);  // ticks skipped count too
+    else now = tick;
+    sampled = TRUE;
+    if (line == last_line) return;
+    last_line = line;
+    crossing(line, now);
+}
+
+void curve_update(int16_t right_mmps, int16_t left_mmps) {
+    uint16_t t = now, age;
+    int16_t limit, speed, turn;
+    int32_t h, k, ds;
+    uint16_t dt;
+
+    if (level == NO_LEVEL) {
+        lateral_now = 0;
+        have_heading = FALSE;
+        return;
+    }
+
+    // Since the last crossing the tape stayed in its band
+    age = t - edge_tick;
+    lateral_now = edges == 2 ? lateral : 0;
+    if (age) {
+        limit = mm_per_s(lateral_now >= 0 ? high_of(level) - edge_y : edge_y - low_of(level), age);
+        if (lateral_now > limit) lateral_now = limit;
+        if (lateral_now < -limit) lateral_now = -limit;
+    }
+    h = (int32_t)edge_y + (int32_t)lateral_now * Q * age * CURVE_TICK_MS / 1000;
+    if (h > high_of(level)) h = high_of(level);
+    if (h < low_of(level)) h = low_of(level);
+    offset_q = (int16_t)h;
+
+    // Heading and curvature, moving forward only
+    speed = (int16_t)((right_mmps + left_mmps) / 2);
+    if (speed < CURVE_MIN_MMPS) {
+        have_heading = FALSE;
+        curvature = 0;
+        return;
+    }
+    turn = (int16_t)((int32_t)(right_mmps - left_mmps) * CURVE_AHEAD_MM / ODO_TRACK_MM);  // sensors swinging, mm/s
+    h = ((int32_t)lateral_now + turn) * 1000 / speed;
+    if (h > 1571) h = 1571;  // the small-angle estimate, within +-90 degrees
+    if (h < -1571) h = -1571;
+
+    // The tape turned by what the cart turned plus the change of heading;
+    // over the distance travelled that is its curvature, averaged over
+    // about CURVE_WINDOW_MM. Angles in urad, so urad/mm = 1000/m.
+    if (have_heading && t != update_tick) {
+        dt = (uint16_t)(t - update_tick) * CURVE_TICK_MS;
+        ds = (int32_t)speed * dt / 1000;
+        if (ds > CURVE_WINDOW_MM) ds = CURVE_WINDOW_MM;
+        k = (int32_t)(right_mmps - left_mmps) * dt * 1000 / ODO_TRACK_MM + (h - heading) * 1000;
+        curvature += (k - curvature * ds) / CURVE_WINDOW_MM;
+        if (curvature > 32767) curvature = 32767;
+        if (curvature < -32767) curvature = -32767;
+    }
+    heading = (int16_t)h;
+    have_heading = TRUE;
+    update_tick = t;
+}
+
+int16_t curve_offset(void) {
+    return offset_q / Q;
+}
+
+int16_t curve_lateral(void) {
+    return lateral_now;
+}
+
+int16_t curve_heading(void) {
+    return heading;
+}
+
+int16_t curve_curvature(void) {
+    return (int16_t)curvature;
+}
+
@@ -0,0 +1,85 @@
+/*
+
+Line-sensor edge timing: tape offset, lateral speed, heading and curvature
+
+The three line sensors only tell in which of five bands the tape is, but the
+moment the pattern changes is the moment an edge of the tape crosses a
+sensor, and where that happens is known from the geometry:
+
+    level      -2     -1      0      1      2      (+ = tape to the left)
+    pattern   001    011    010    110    100
+    crossing      -b2    -b1    b1     b2          b1 = pitch - tape / 2
+                                                   b2 = tape / 2
+
+curve_sample() runs in the main loop every CURVE_TICK_MS with the sensor
+pattern and the tick it belongs to: the Timer 0 interrupt only posts the
+tick to the deferred-event ring (defer.h), and the handler reads the sensor,
+so the conversions stay out of the interrupt. Each change is taken as a
+crossing at once. curve_update() runs every control tick with the wheel
+speeds and estimates, in fixed point:
+
+    offset     where the tape is now, mm: the last crossing moved on at the
+               lateral speed, kept inside the current band
+    lateral    how fast the tape moves across the sensors, mm/s, from the
+               last two crossings; never more than the band's width over the
+               time since the last one, so it decays while nothing changes
+    heading    angle of the tape to the cart, mrad:
+               (lateral + ahead * turn rate) / speed
+    curvature  of the tape, 1000/m (1000 = 1 m radius): the cart's own
+               curvature from the wheel speeds, plus how fast the heading
+               changes per mm travelled, filtered
+
+The sensors sit CURVE_AHEAD_MM ahead of the axle, so the heading and the
+curvature are known while the tape is still under the centre sensor, before
+the cart has drifted off it. Patterns 111 (crossing), 000 and 101 (lost) give
+no position; the estimate restarts at the next valid crossing.
+
+A reading is taken when the main loop gets to the event, at most a pass of
+the loop after its tick. Ticks the loop never got to (the ring full, or a
+sample still waiting) are skipped, and the next sample still carries its
+own tick, so the times stay right.
+
+Example C:
+// Timer 0 interrupt, every 5 ms: at most one sample waiting
+if (line_sampling && !line_due) {
+    line_due = TRUE;
+    if (!defer_post(EV_LINE, ticks)) line_due = FALSE;
+}
+
+// EV_LINE handler, main loop
+void line_tick(uint8_t tick) {
+    curve_sample(sensorLine_read(), tick);
+    line_due = FALSE;
+}
+
+// every control tick, speeds in mm/s (right, left)
+curve_update(right_mmps, left_mmps);
+follow_curvature(curve_curvature());
+follow_step(curve_line(), duty, turn_pct);
+
+*/
+
+#ifndef CURVE_H
+#define CURVE_H
+
+#include <stdint.h>
+
+#define CURVE_TICK_MS 5     // curve_sample() period
+#define CURVE_PITCH_MM 12   // between neighbouring line sensors
+#define CURVE_TAPE_MM 19    // width of the tape, more than the pitch
+#define CURVE_AHEAD_MM 60   // line sensors ahead of the axle
+#define CURVE_MIN_MMPS 50   // slower than this, no heading or curvature
+#define CURVE_WINDOW_MM 400 // curvature averaged over about this distance
+
+void curve_init(void);
+void curve_sample(uint8_t line, uint8_t tick);  // tick: CURVE_TICK_MS count, low byte
+uint8_t curve_line(void);                       // latest pattern, bits 2..0 = left, centre, right
+char curve_ready(void);                         // curve_sample() has run since curve_init()
+
+void curve_update(int16_t right_mmps, int16_t left_mmps);
+int16_t curve_offset(void);     // mm, + = tape left of centre
+int16_t curve_lateral(void);    // mm/s, + = tape moving left
+int16_t curve_heading(void);    // mrad, + = tape heading left of the cart
+int16_t curve_curvature(void);  // 1000/m, + = bending left
+
+#endif
@@ -0,0 +1,77 @@
+#include <stddef.h>
+
+#include "always.h"
+#include "defer.h"
+
+#if DEFER_RING & (DEFER_RING - 1)
+#error "DEFER_RING must be a power of 2"
+#endif
+
+struct defer_event {
+    uint8_t type;
+    uint8_t arg;
+};
+
+// Ring: free-running indices, head written by the interrupt, tail by the main loop
+static struct defer_event ring[DEFER_RING];
+static volatile uint8_t head, tail;
+static volatile uint8_t high_water;
+static volatile uint8_t overruns[DEFER_TYPES];
+
+static defer_handler handlers[DEFER_TYPES];
+
+void defer_init(void) {
+    uint8_t i;
+
+    head = tail = 0;
+    high_water = 0;
+    for (i = 0; i < DEFER_TYPES; i++) {
+        overruns[i] = 0;
+        handlers[i] = NULL;
+    }
+}
+
+void defer_register(uint8_t type, defer_handler handler) {
+    if (type < DEFER_TYPES) handlers[type] = handler;
+}
+
+char defer_post(uint8_t type, uint8_t arg) {
+    uint8_t used = (uint8_t)(head - tail);
+    struct defer_event *ev;
+
+    if (used >= DEFER_RING) {
+        if (type < DEFER_TYPES && overruns[type] < 255) overruns[type]++;
+        return FALSE;
+    }
+    if (used >= high_water) high_water = used + 1;
+    ev = &ring[head & (DEFER_RING - 1)];
+    ev->type = type;
+    ev->arg = arg;
+    head++;  // after the event is complete
+    return TRUE;
+}
+
+uint8_t defer_dispatch(void) {
+    struct defer_event ev;
+    uint8_t n = 0;
+
+    while (tail != head) {
+        ev = ring[tail & (DEFER_RING - 1)];
+        tail++;  // after the copy, the slot may be reused
+        if (ev.type < DEFER_TYPES && handlers[ev.type]) handlers[ev.type](ev.arg);
+        n++;
+    }
+    return n;
+}
+
+uint8_t defer_waiting(void) {
+    return (uint8_t)(head - tail);
+}
+
+uint8_t defer_high_water(void) {
+    return high_water;
+}
+
+uint8_t defer_overruns(uint8_t type) {
+    return type < DEFER_TYPES ? overruns[type] : 0;
+}
@@ -0,0 +1,60 @@
+/*
+
+Deferred work: events from the interrupt to handlers run by the main loop
+
+The PIC16 has one interrupt vector and no priorities, so every instruction
+an interrupt source spends delays all the others, encoder edges included.
+A source whose work can wait for the main loop only captures what it needs,
+one byte, and posts it with its event type:
+
+    if (EEIE && EEIF) {
+        EEIF = 0;
+        defer_post(EV_EEPROM, 0);   // a few dozen instruction cycles
+    }
+
+The main loop registers a handler per type once and calls defer_dispatch()
+at every pass, which runs the handler of every waiting event, oldest first.
+
+The events wait in a ring of DEFER_RING entries with one writer, the
+interrupt, and one reader, the main loop, each owning its own index, so
+neither side disables interrupts. It is the one ring for every kind of
+event: input.h posts key presses to it, and a program can post the tick
+of a sensor reading it wants taken in the main loop (see curve.h). When the ring is full an event is dropped and
+counted against its type. The most events ever waiting at once is kept, to
+size DEFER_RING from a real run.
+
+Only post from the interrupt: defer_post() is not reentrant. Everything is
+plain C, so the module builds on the host.
+
+Example C:
+enum { EV_EEPROM, EV_TYPES };
+
+defer_init();
+defer_register(EV_EEPROM, eeprom_written);  // void eeprom_written(uint8_t arg)
+while (1) {
+    defer_dispatch();
+    ...
+}
+
+*/
+
+#ifndef DEFER_H
+#define DEFER_H
+
+#include <stdint.h>
+
+#define DEFER_RING 8   // events waiting for the main loop, power of 2
+#define DEFER_TYPES 4  // event types 0..DEFER_TYPES-1
+
+typedef void (*defer_handler)(uint8_t arg);
+
+void defer_init(void);
+void defer_register(uint8_t type, defer_handler handler);
+char defer_post(uint8_t type, uint8_t arg);  // interrupt; FALSE if dropped
+uint8_t defer_dispatch(void);                // main loop; events handled
+
+uint8_t defer_waiting(void);              // events in the ring now
+uint8_t defer_high_water(void);           // most events ever waiting at once
+uint8_t defer_overruns(uint8_t type);     // events of that type dropped, saturating
+
+#endif
@@ -0,0 +1,77 @@
+#include <xc.h>
+
+#include "always.h"
+#include "bits.h"
+#include "drive.h"
+#include "pwm.h"
+
+static int16_t output[2];  // duty cycle applied, + = forward
+static char reverse[2];    // direction bit set for backwards
+static uint8_t rest[2];    // drive_set() calls since the motor was last powered, saturating
+
+static void direction(char channel, char backwards) {
+    uint8_t level = backwards ? !DRIVE_DIR_FORWARD : DRIVE_DIR_FORWARD;
+
+    if (channel == 1)
+        pin_write(DRIVE_DIR1_PIN, level);
+    else
+        pin_write(DRIVE_DIR2_PIN, level);
+    reverse[channel - 1] = backwards;
+}
+
+void drive_init(void) {
+    pwm_set(1, 0);
+    pwm_set(2, 0);
+    direction(1, FALSE);
+    direction(2, FALSE);
+    pin_clr(DRIVE_DIR1_TRIS);  // outputs
+    pin_clr(DRIVE_DIR2_TRIS);
+    output[0] = output[1] = 0;
+    rest[0] = rest[1] = DRIVE_DEAD_TICKS;
+}
+
+void drive_set(char channel, int16_t duty) {
+    uint8_t i = (uint8_t)(channel - 1);
+    char backwards = duty < 0;
+
+    if (duty > DRIVE_DUTY_MAX) duty = DRIVE_DUTY_MAX;
+    if (duty < -DRIVE_DUTY_MAX) duty = -DRIVE_DUTY_MAX;
+
+    // The other way: unpowered for the dead time, then the direction bit
+    if (duty != 0 && backwards != reverse[i]) {
+        if (rest[i] < DRIVE_DEAD_TICKS)
+            duty = 0;
+        else
+            direction(channel, backwards);
+    }
+    if (duty == 0) {
+        if (rest[i] < 255) rest[i]++;
+    } else {
+        rest[i] = 0;
+    }
+
+    output[i] = duty;
+    pwm_set(channel, duty < 0 ? -duty : duty);
+}
+
+char drive_brake(char channel, int16_t setpoint, int16_t speed) {
+    int16_t over;
+    int32_t duty;
+
+    // Excess speed in the direction the wheel turns; a setpoint the other
+    // way counts as 0, the reversal comes after the stop
+    if (speed >= 0)
+        over = speed - (setpoint > 0 ? setpoint : 0);
+    else
+        over = -speed - (setpoint < 0 ? -setpoint : 0);
+    if (over <= DRIVE_BRAKE_MARGIN) return FALSE;
+
+    duty = (int32_t)over * DRIVE_BRAKE_PCT / 100;
+    if (duty > DRIVE_BRAKE_MAX) duty = DRIVE_BRAKE_MAX;
+    drive_set(channel, (int16_t)(speed >= 0 ? -duty : duty));
+    return TRUE;
+}
+
+int16_t drive_get(char channel) {
+    return output[channel - 1];
+}
@@ -0,0 +1,75 @@
+/*
+
+Signed motor drive: direction bits, dead time and braking
+
+Each motor is driven by its PWM channel (pwm_set(), magnitude) and a
+direction bit. drive_set() takes a signed duty cycle, -1023..1023 with
++ = forward, and sets both, so the rest of the program, like ffwd_duty() and
+profile.h, works with signed speeds and a wheel can turn backwards.
+
+Reversing a motor that is powered is never done in one step: the duty cycle
+goes to 0 first and the direction bit only changes after the motor has been
+unpowered for DRIVE_DEAD_TICKS calls of drive_set() (one control tick), so
+the winding current decays through the bridge before it is driven the other
+way, and the bridge never sees both directions at once.
+
+With only a PWM and a direction input the bridge cannot be told to short
+the winding, so duty 0 lets the wheel coast (or brake, if the driver's
+off-time is a slow decay). drive_brake() slows a wheel harder with a reverse
+pulse: while the wheel's measured speed is above its setpoint by more than
+DRIVE_BRAKE_MARGIN, the motor is driven backwards with a duty cycle
+proportional to the excess, up to DRIVE_BRAKE_MAX. The pulse shrinks as the
+wheel slows and ends before it stops, so braking never drives the wheel
+backwards; a setpoint in the other direction is reached through a stop and
+the dead time.
+
+Speeds and setpoints are in the profile's unit (profile.h), the duty cycle a
+matched wheel needs for that speed, so the excess is directly a duty cycle.
+Without encoders, a speed of 0 never brakes and the wheels coast as before.
+
+The direction pins and their TRIS bits are bits.h descriptors and can be
+defined before this header is included; the defaults below are an
+assumption, set them to the board's wiring.
+
+Example C:
+pwm_init();
+drive_init();                                   // both wheels forward, stopped
+...
+if (control_tick) {
+    profile_step();
+    if (!drive_brake(1, profile_get(1), speed1))
+        drive_set(1, vbat_scale(ffwd_duty(1, profile_get(1))));
+    ...
+}
+
+*/
+
+#ifndef DRIVE_H
+#define DRIVE_H
+
+#include <stdint.h>
+
+#ifndef DRIVE_DIR1_PIN
+#define DRIVE_DIR1_PIN PORTA, 4    // direction bit of channel 1
+#define DRIVE_DIR1_TRIS TRISA, 4
+#endif
+#ifndef DRIVE_DIR2_PIN
+#define DRIVE_DIR2_PIN PORTB, 6    // direction bit of channel 2
+#define DRIVE_DIR2_TRIS TRISB, 6
+#endif
+#ifndef DRIVE_DIR_FORWARD
+#define DRIVE_DIR_FORWARD 0        // level of a direction bit for forward
+#endif
+
+#define DRIVE_DUTY_MAX 1023
+#define DRIVE_DEAD_TICKS 1         // drive_set() calls unpowered before a reversal
+#define DRIVE_BRAKE_MARGIN 60      // speed above the setpoint that starts braking
+#define DRIVE_BRAKE_PCT 100        // reverse duty, percent of the excess speed
+#define DRIVE_BRAKE_MAX 600        // strongest reverse duty
+
+void drive_init(void);
+void drive_set(char channel, int16_t duty);  // + = forward
+char drive_brake(char channel, int16_t setpoint, int16_t speed);  // TRUE: braking, the duty is set
+int16_t drive_get(char channel);             // duty cycle applied, + = forward
+
+#endif
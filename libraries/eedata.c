@@ -0,0 +1,37 @@
+#include <xc.h>
+
+#include "always.h"
+#include "eedata.h"
+
+uint8_t eedata_claim(void) {
+    uint8_t gie;
+
+    while (1) {
+        gie = GIE;
+        gie_off;
+        if (!EECON1bits.WR && !(EEIE && EEIF)) return gie;
+        if (gie) gie_on;
+    }
+}
+
+void eedata_release(uint8_t gie) {
+    if (gie) gie_on;
+}
+
+void eedata_write(uint8_t addr, uint8_t data) {
+    uint8_t gie = eedata_claim();
+
+    if (EEPROM_READ(addr) != data) {
+        EEADR = addr;
+        EEDAT = data;
+        EECON1bits.EEPGD = 0;  // data memory
+        EECON1bits.WREN = 1;
+        EECON2 = 0x55;  // required sequence
+        EECON2 = 0xAA;
+        EECON1bits.WR = 1;
+        EECON1bits.WREN = 0;
+    }
+    eedata_release(gie);
+    while (EECON1bits.WR)
+        ;  // about 4 ms
+}
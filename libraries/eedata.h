@@ -0,0 +1,39 @@
+/*
+
+Blocking data-EEPROM access that coexists with the black box
+
+The black box (blackbox.h) writes the EEPROM from its interrupt, one byte
+after the other, and nothing may touch EEADR while one of its writes runs.
+eedata_claim() waits until no write is running or about to be continued by
+the EEPROM interrupt, and returns with interrupts off, so the caller can read
+or start a write of its own. A black-box write only finishes with interrupts
+on, so claim the EEPROM before bbox_init() or after GIE = 1. When the
+black box is continued from the main loop instead (defer.h), a write of
+eedata may fall between two bytes of a record, which is harmless.
+
+Used by the parameter table (params.h) and the motor feed-forward table
+(ffwd.h). Each owns a fixed range:
+
+    0x00..0x3F  parameters
+    0x40..0x7F  motor feed-forward
+    0x80..0xFF  black box
+
+Example C:
+uint8_t gie = eedata_claim();
+value = EEPROM_READ(addr);
+eedata_release(gie);
+
+eedata_write(addr, value);  // about 4 ms, skipped if unchanged
+
+*/
+
+#ifndef EEDATA_H
+#define EEDATA_H
+
+#include <stdint.h>
+
+uint8_t eedata_claim(void);  // returns the previous GIE
+void eedata_release(uint8_t gie);
+void eedata_write(uint8_t addr, uint8_t data);
+
+#endif
@@ -0,0 +1,149 @@
+#include <xc.h>
+
+#include "always.h"
+#include "encoder.h"
+
+#if ENC_MODE != ENC_X4 && ENC_MODE != ENC_X2 && ENC_MODE != ENC_X1 && ENC_MODE != ENC_HYBRID
+#error "ENC_MODE must be ENC_X4, ENC_X2, ENC_X1 or ENC_HYBRID"
+#endif
+
+#define ENC1_SHIFT 3  // RB3 = A, RB4 = B
+#define ENC2_SHIFT 1  // RB1 = A, RB2 = B
+
+static volatile int16_t counts[2];
+
+#if ENC_MODE == ENC_X4
+// Count change for (last state << 2) | state, state = B:A; same table that
+// used to be kept in EEPROM
+static const int8_t quad_table[16] = {
+    0, 1, -1, 0,
+    -1, 0, 0, 1,
+    1, 0, 0, -1,
+    0, -1, 1, 0,
+};
+static uint8_t last_state;  // wheel 1 in bits 2..3, wheel 2 in bits 0..1
+#else
+static uint8_t last_a;  // A of wheel 1 in bit 1, wheel 2 in bit 0
+#endif
+
+#if ENC_MODE == ENC_HYBRID
+static uint16_t last_timer;
+static int8_t direction1 = 1;
+#endif
+
+void enc_init(void) {
+    uint8_t portb;
+
+    TRISB1 = 1;  // encoder inputs
+    TRISB2 = 1;
+    TRISB3 = 1;
+    TRISB4 = 1;
+    ANS8 = 0;  // RB2/AN8 digital
+    ANS9 = 0;  // RB3/AN9 digital
+    ANS10 = 0; // RB1/AN10 digital
+    ANS11 = 0; // RB4/AN11 digital
+
+    counts[0] = counts[1] = 0;
+    portb = PORTB;
+
+#if ENC_MODE == ENC_X4
+    last_state = (uint8_t)((((portb >> ENC1_SHIFT) & 3) << 2) | ((portb >> ENC2_SHIFT) & 3));
+    IOCB |= 0b00011110;  // RB1..RB4
+#elif ENC_MODE == ENC_HYBRID
+    last_a = (portb >> ENC2_SHIFT) & 1;
+    IOCB |= 0b00000010;  // RB1 only, wheel 1 is on Timer 1
+
+    TRISC0 = 1;               // T1CKI input
+    T1CONbits.TMR1CS = 1;     // clock from T1CKI, rising edges
+    T1CONbits.T1CKPS = 0;     // 1:1
+    T1CONbits.T1OSCEN = 0;    // no crystal oscillator
+    T1CONbits.T1SYNC = 0;     // synchronized to the CPU clock
+    TMR1H = 0;
+    TMR1L = 0;
+    last_timer = 0;
+    T1CONbits.TMR1ON = 1;
+#else
+    last_a = (uint8_t)((((portb >> ENC1_SHIFT) & 1) << 1) | ((portb >> ENC2_SHIFT) & 1));
+    IOCB |= 0b00001010;  // RB1 and RB3, the A channels
+#endif
+
+    RBIF = 0;
+    RBIE = 1;
+}
+
+#if ENC_MODE == ENC_X2 || ENC_MODE == ENC_X1 || ENC_MODE == ENC_HYBRID
+// Count change of one wheel when its A channel may have changed
+static int8_t decode_a(uint8_t state, uint8_t mask) {
+    uint8_t phase_a = state & 1;
+    uint8_t phase_b = (state >> 1) & 1;
+
+    if (phase_a == ((last_a & mask) != 0)) return 0;  // the other wheel moved
+    last_a ^= mask;
+
+#if ENC_MODE == ENC_X1
+    if (!phase_a) return 0;  // count rising edges only
+    return phase_b ? -4 : 4;
+#else
+    return (phase_a != phase_b) ? 2 : -2;
+#endif
+}
+#endif
+
+void enc_isr(uint8_t portb) {
+#ifdef ENC_TIMING_PIN
+    ENC_TIMING_PIN = 1;
+#endif
+
+#if ENC_MODE == ENC_X4
+    uint8_t state = (uint8_t)((((portb >> ENC1_SHIFT) & 3) << 2) | ((portb >> ENC2_SHIFT) & 3));
+
+    counts[0] += quad_table[(last_state & 0b1100) | (state >> 2)];
+    counts[1] += ENC_CH2_SIGN * quad_table[((last_state & 0b0011) << 2) | (state & 3)];
+    last_state = state;
+#else
+#if ENC_MODE != ENC_HYBRID
+    counts[0] += decode_a((portb >> ENC1_SHIFT) & 3, 0b10);
+#endif
+    counts[1] += ENC_CH2_SIGN * decode_a((portb >> ENC2_SHIFT) & 3, 0b01);
+#endif
+
+#ifdef ENC_TIMING_PIN
+    ENC_TIMING_PIN = 0;
+#endif
+}
+
+void enc_sample(void) {
+#if ENC_MODE == ENC_HYBRID
+    uint8_t high, low;
+    uint16_t now;
+
+    // Timer 1 keeps counting: read high, low, and high again in case of a carry
+    do {
+        high = TMR1H;
+        low = TMR1L;
+    } while (high != TMR1H);
+    now = ((uint16_t)high << 8) | low;
+
+    counts[0] += (int16_t)(now - last_timer) * 4 * direction1;
+    last_timer = now;
+#endif
+}
+
+void enc_direction(char channel, int8_t direction) {
+#if ENC_MODE == ENC_HYBRID
+    if (channel == 1) direction1 = direction < 0 ? -1 : 1;
+#else
+    (void)channel;
+    (void)direction;
+#endif
+}
+
+int16_t enc_count(char channel) {
+    int16_t value;
+    uint8_t gie = GIE;
+
+    gie_off;  // 16-bit value shared with the ISR
+    value = counts[channel - 1];
+    if (gie) gie_on;
+    return value;
+}
@@ -0,0 +1,67 @@
+/*
+
+Quadrature encoders of both wheels
+
+Wheel 1 (left) is on RB3 (A) and RB4 (B), wheel 2 (right) on RB1 (A) and
+RB2 (B). The decoding mode is chosen at compile time with ENC_MODE, trading
+resolution for interrupt load:
+
+    mode        counted edges         IOC pins    interrupts / wheel rev
+    ENC_X4      A and B, both edges   RB1..RB4    48
+    ENC_X2      A, both edges         RB1, RB3    24
+    ENC_X1      A, rising edge        RB1, RB3    24 (falling edges ignored)
+    ENC_HYBRID  wheel 1: A clocks Timer 1 on RC0/T1CKI, no interrupt at all
+                wheel 2: as ENC_X2
+
+Counts are always returned in X4 units (48 per wheel revolution), so
+odometry and speed code do not depend on the mode; lower modes just move in
+steps of 2 or 4.
+
+Estimated cost at 20 MHz (5 MIPS), counting the XC8 context save/restore:
+ENC_X4 about 90 instruction cycles per interrupt (table lookup for both
+wheels), ENC_X2/ENC_X1 about 60. With the CPU fully spent on encoders that
+is ~55 k and ~80 k interrupts/s; keep well under a third of that to leave
+room for control. Define ENC_TIMING_PIN (e.g. RC3) to raise a pin for the
+duration of enc_isr() and measure the real figures with a scope.
+
+In ENC_HYBRID, Timer 1 cannot tell direction: wheel 1 counts in the
+direction given by enc_direction(), normally the sign of the wheel's speed
+setpoint (not of a reverse braking pulse, which slows the wheel without
+turning it backwards), and only while enc_sample() runs every tick. The A
+output of encoder 1 must be wired to RC0.
+
+Example C:
+void __interrupt() isr(void) {
+    if (TMR0IE && TMR0IF) { enc_sample(); ... }   // hybrid mode only needs it
+    if (RBIE && RBIF) { enc_isr(PORTB); RBIF = 0; }
+}
+...
+enc_init();
+left = enc_count(1);
+
+*/
+
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#include <stdint.h>
+
+#define ENC_X1 1
+#define ENC_X2 2
+#define ENC_X4 4
+#define ENC_HYBRID 8
+
+#ifndef ENC_MODE
+#define ENC_MODE ENC_X4
+#endif
+
+#define ENC_COUNTS_PER_REV 48  // in X4 units, whatever the mode
+#define ENC_CH2_SIGN (-1)      // wheel 2 is mounted mirrored
+
+void enc_init(void);
+void enc_isr(uint8_t portb);
+void enc_sample(void);
+void enc_direction(char channel, int8_t direction);
+int16_t enc_count(char channel);
+
+#endif
@@ -0,0 +1,98 @@
+#include <xc.h>
+
+#include "always.h"
+#include "eedata.h"
+#include "ffwd.h"
+
+static int16_t table[2][FFWD_POINTS];  // duty cycle per speed point, per wheel
+static int16_t top;                     // counts/s at FFWD_FULL, 0 = no table
+
+// EEPROM: magic, top speed, wheel 1 table, wheel 2 table (low byte first), checksum
+#define EE_SIZE (1 + 2 + 2 * FFWD_POINTS * 2 + 1)
+#if FFWD_EE_START + EE_SIZE > FFWD_EE_END
+#error "feed-forward table does not fit its EEPROM range"
+#endif
+
+static int16_t read16(uint8_t addr) {
+    return (int16_t)((uint16_t)EEPROM_READ(addr) | (uint16_t)EEPROM_READ(addr + 1) << 8);
+}
+
+static uint8_t checksum_ee(void) {
+    uint8_t sum = 0;
+    uint8_t i;
+
+    for (i = 0; i < EE_SIZE - 1; i++) sum += EEPROM_READ(FFWD_EE_START + i);
+    return sum ^ 0x5A;
+}
+
+void ffwd_init(void) {
+    uint8_t gie = eedata_claim();
+    uint8_t c, i, addr;
+
+    top = 0;
+    if (EEPROM_READ(FFWD_EE_START) == FFWD_MAGIC && EEPROM_READ(FFWD_EE_START + EE_SIZE - 1) == checksum_ee()) {
+        addr = FFWD_EE_START + 3;
+        for (c = 0; c < 2; c++) {
+            for (i = 0; i < FFWD_POINTS; i++, addr += 2) table[c][i] = read16(addr);
+        }
+        top = read16(FFWD_EE_START + 1);
+    }
+    eedata_release(gie);
+}
+
+char ffwd_valid(void) {
+    return top != 0;
+}
+
+int16_t ffwd_top_speed(void) {
+    return top;
+}
+
+int16_t ffwd_duty(char channel, int16_t speed) {
+    const int16_t *t = table[channel - 1];
+    int16_t s = speed < 0 ? -speed : speed;
+    int16_t duty;
+    uint8_t i;
+
+    if (!top || speed == 0) return speed;
+    if (s > FFWD_FULL) s = FFWD_FULL;
+
+    i = (uint8_t)(s >> FFWD_SHIFT);
+    duty = t[i] + (int16_t)(((int32_t)(t[i + 1] - t[i]) * (s & ((1 << FFWD_SHIFT) - 1))) >> FFWD_SHIFT);
+    if (duty > FFWD_DUTY_MAX) duty = FFWD_DUTY_MAX;
+    return speed < 0 ? -duty : duty;
+}
+
+void ffwd_set(const int16_t new_table[2][FFWD_POINTS], int16_t top_speed) {
+    uint8_t c, i;
+
+    for (c = 0; c < 2; c++) {
+        for (i = 0; i < FFWD_POINTS; i++) table[c][i] = new_table[c][i];
+    }
+    top = top_speed;
+}
+
+int16_t ffwd_entry(char channel, uint8_t point) {
+    return table[channel - 1][point];
+}
+
+char ffwd_save(void) {
+    uint8_t addr = FFWD_EE_START;
+    uint8_t sum = 0;
+    uint8_t c, i, v;
+
+    if (!top) return FALSE;
+
+    eedata_write(addr++, FFWD_MAGIC);
+    sum += FFWD_MAGIC;
+    for (c = 0; c < 1 + 2 * FFWD_POINTS; c++) {  // top speed, then both tables
+        int16_t value = c == 0 ? top : table[(c - 1) / FFWD_POINTS][(c - 1) % FFWD_POINTS];
+        for (i = 0; i < 2; i++) {
+            v = (uint8_t)((uint16_t)value >> (8 * i));
+            sum += v;
+            eedata_write(addr++, v);
+        }
+    }
+    eedata_write(addr, sum ^ 0x5A);
+    return TRUE;
+}
@@ -0,0 +1,55 @@
+/*
+
+Motor feed-forward: linear, matched wheel speeds from the duty cycle
+
+The two motors start moving only above some duty cycle (dead band), and do
+not turn at the same speed for the same duty cycle. This module keeps, for
+each wheel, a table of the duty cycle needed for FFWD_POINTS evenly spaced
+speeds, measured on the cart by the characterization routine (mchar.h).
+ffwd_duty() interpolates it, so a program asks for a speed instead of a duty
+cycle:
+
+    speed 0..FFWD_FULL   (FFWD_FULL = the top speed both wheels can reach)
+    duty  0..1023        as for pwm_set()
+
+Speed 0 gives duty 0; the smallest speed already gives the dead-band duty,
+so the wheel really turns. Negative speeds give negative duty cycles, for a
+drive layer that handles the direction.
+
+The table is kept in EEPROM bytes FFWD_EE_START..FFWD_EE_END (see eedata.h).
+Without a saved table ffwd_duty() returns the speed unchanged, so programs
+behave as before the characterization.
+
+Example C:
+ffwd_init();                                  // load the saved table
+...
+pwm_set(1, ffwd_duty(1, profile_get(1)));     // same speed on both wheels
+pwm_set(2, ffwd_duty(2, profile_get(2)));
+
+*/
+
+#ifndef FFWD_H
+#define FFWD_H
+
+#include <stdint.h>
+
+#define FFWD_POINTS 9       // speeds 0, 1/8, ..., 8/8 of FFWD_FULL
+#define FFWD_SHIFT 7        // FFWD_FULL / (FFWD_POINTS - 1) = 128
+#define FFWD_FULL 1023
+#define FFWD_DUTY_MAX 1023
+
+#define FFWD_EE_START 0x40  // EEPROM bytes 0x40..0x7F
+#define FFWD_EE_END 0x80
+#define FFWD_MAGIC 0xF1
+
+void ffwd_init(void);
+char ffwd_valid(void);
+int16_t ffwd_duty(char channel, int16_t speed);
+int16_t ffwd_top_speed(void);  // X4 encoder counts per second at FFWD_FULL, 0 without a table
+
+// Used by the characterization
+void ffwd_set(const int16_t table[2][FFWD_POINTS], int16_t top_speed);
+char ffwd_save(void);
+int16_t ffwd_entry(char channel, uint8_t point);
+
+#endif
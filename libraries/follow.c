@@ -0,0 +1,76 @@
+#include "always.h"
+#include "follow.h"
+#include "odometry.h"  // ODO_TRACK_MM
+#include "profile.h"
+
+static int16_t curvature;  // ahead: drive this curve, 1000/m
+static uint8_t pivot;      // inner wheel backwards on an outer sensor alone and lost, %; 0 = off
+static char went_left;     // the tape was last seen to the left
+
+void follow_init(void) {
+    curvature = 0;
+    went_left = FALSE;
+}
+
+uint8_t follow_steer(uint8_t line) {
+    switch (line) {
+    case 2:
+    case 7:
+        return FOLLOW_AHEAD;
+    case 6:
+    case 4:
+        return FOLLOW_LEFT;
+    case 3:
+    case 1:
+        return FOLLOW_RIGHT;
+    default:
+        return FOLLOW_LOST;
+    }
+}
+
+uint8_t follow_step(uint8_t line, int duty, uint8_t turn_pct) {
+    int turn = (int)((long)duty * turn_pct / 100);  // inner wheel in turns
+    int sharp = pivot ? -(int)((long)duty * pivot / 100) : turn;  // inner wheel in the sharpest cases
+    uint8_t steer = follow_steer(line);
+    int inner;
+    long slow;
+
+    switch (steer) {
+    case FOLLOW_AHEAD:
+        // inner / outer = 1 - curvature * track, for a small curvature
+        slow = (long)(curvature < 0 ? -curvature : curvature) * ODO_TRACK_MM / 1000;  // per mille
+        inner = slow >= 1000 ? 0 : duty - (int)(duty * slow / 1000);
+        if (inner < turn) inner = turn;
+        profile_set(1, curvature < 0 ? inner : duty);  // bending right: right wheel inside
+        profile_set(2, curvature > 0 ? inner : duty);
+        break;
+    case FOLLOW_LEFT:
+        went_left = TRUE;
+        profile_set(1, duty);
+        profile_set(2, line == 4 ? sharp : turn);
+        break;
+    case FOLLOW_RIGHT:
+        went_left = FALSE;
+        profile_set(1, line == 1 ? sharp : turn);
+        profile_set(2, duty);
+        break;
+    default:  // circling towards the side the tape was last seen
+        if (went_left) {
+            profile_set(1, duty);
+            profile_set(2, sharp);
+        } else {
+            profile_set(1, sharp);
+            profile_set(2, duty);
+        }
+        break;
+    }
+    return steer;
+}
+
+void follow_curvature(int16_t k) {
+    curvature = k;
+}
+
+void follow_pivot(uint8_t pct) {
+    pivot = pct;
+}
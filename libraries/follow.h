@@ -0,0 +1,59 @@
+/*
+
+Line following: wheel speeds from the 3-bit line sensor
+
+The decision the autonomous task makes at every pass of its main loop, kept
+apart from the hardware so the host batch simulation (tools/tracksim.c) runs
+exactly the same rule as the cart.
+
+    line   bits 2..0 = left, centre, right sensor, 1 = over the tape
+    010, 111        ahead: both wheels at duty
+    110, 100        tape to the left: right wheel (1) at duty, left (2) at turn
+    011, 001        tape to the right: right wheel at turn, left at duty
+    000, 101        lost: circle towards the side the tape was last seen,
+                    to the right after follow_init()
+
+The speeds go to profile_set(), so they are ramped like any other request;
+turn_pct is the inner wheel's speed in percent of the outer one.
+
+Ahead, the wheels are at the same speed unless follow_curvature() gave the
+tape's curvature (curve.h): the inner wheel is then slowed so the cart
+drives that curve, never below the turn speed, and a bend is taken while the
+tape is still under the centre sensor instead of after losing it.
+
+follow_pivot() turns the inner wheel backwards, at that percent of duty, in
+the sharpest cases: the tape under an outer sensor alone (100, 001) and
+lost. The cart then pivots about a point between the wheels, taking a
+hairpin or sweeping round to find the tape in less room. Backwards needs a
+drive layer that handles the direction (drive.h). With 0, the default,
+these cases use turn_pct like the others.
+
+Example C:
+follow_init();  // at the start of a run
+duty_cycle = ttc_duty_limit(param[P_DUTY_MAX]);
+switch (follow_step(sensorLine_read(), duty_cycle, param[P_TURN_PCT])) {
+case FOLLOW_AHEAD:
+    led_rgb_set_color(GREEN);
+    break;
+...
+}
+
+*/
+
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include <stdint.h>
+
+#define FOLLOW_AHEAD 0
+#define FOLLOW_LEFT 1
+#define FOLLOW_RIGHT 2
+#define FOLLOW_LOST 3
+
+void follow_init(void);              // straight ahead, tape last seen to the right
+uint8_t follow_steer(uint8_t line);  // FOLLOW_AHEAD..FOLLOW_LOST
+uint8_t follow_step(uint8_t line, int duty, uint8_t turn_pct);
+void follow_curvature(int16_t curvature);  // 1000/m, + = left; 0 = straight ahead
+void follow_pivot(uint8_t pct);            // inner wheel backwards, % of duty; 0 = off
+
+#endif
@@ -0,0 +1,93 @@
+#include <xc.h>
+
+#include "always.h"
+#include "defer.h"
+#include "input.h"
+
+#define MS_TICKS(ms) ((uint8_t)(((ms) + INPUT_TICK_MS - 1) / INPUT_TICK_MS))
+#define LONG_TICKS MS_TICKS(INPUT_LONG_MS)
+#define DOUBLE_TICKS MS_TICKS(INPUT_DOUBLE_MS)
+
+#if (INPUT_LONG_MS + INPUT_TICK_MS - 1) / INPUT_TICK_MS > 254 || (INPUT_DOUBLE_MS + INPUT_TICK_MS - 1) / INPUT_TICK_MS > 254
+#error "INPUT_LONG_MS and INPUT_DOUBLE_MS must fit in 254 ticks"
+#endif
+
+// Vertical counter: bit i of cnt0/cnt1 are the two bits of input i's counter
+static uint8_t cnt0, cnt1;
+static volatile uint8_t state;  // debounced inputs
+static uint8_t event;           // defer.h type the changes are posted as
+
+// Long and double presses, interrupt only
+static uint8_t age[INPUT_TIMED];  // ticks since the last change, saturating
+static uint8_t long_sent;         // INPUT_LONG already sent for this press
+static uint8_t armed;             // released after a short press: the next one may be double
+static uint8_t second;            // this press was the second of a double press
+
+void input_init(uint8_t type) {
+    uint8_t gie = GIE;
+    uint8_t i;
+
+    gie_off;
+    cnt0 = cnt1 = 0xFF;
+    state = 0;
+    event = type;
+    for (i = 0; i < INPUT_TIMED; i++) age[i] = 0xFF;
+    long_sent = armed = second = 0;
+    if (gie) gie_on;
+}
+
+static void put(uint8_t type, uint8_t input) {
+    defer_post(event, INPUT_ARG(type, input));  // dropped and counted when the ring is full
+}
+
+void input_tick(uint8_t raw) {
+    uint8_t delta, changed, bit, i;
+
+    for (i = 0; i < INPUT_TIMED; i++)
+        if (age[i] != 0xFF) age[i]++;
+
+    // Counters of inputs equal to the state are reset to 3, the others count
+    // down; an input changes when its counter wraps from 0 to 3
+    delta = raw ^ state;
+    cnt0 = (uint8_t)~(cnt0 & delta);
+    cnt1 = cnt0 ^ (cnt1 & delta);
+    changed = delta & cnt0 & cnt1;
+    state ^= changed;
+
+    if (changed) {
+        for (i = 0, bit = 1; bit; i++, bit <<= 1) {
+            if (!(changed & bit)) continue;
+            if (state & bit) {
+                put(INPUT_PRESS, i);
+                if (i < INPUT_TIMED) {
+                    if ((armed & bit) && age[i] < DOUBLE_TICKS) {
+                        put(INPUT_DOUBLE, i);
+                        second |= bit;
+                    } else {
+                        second &= (uint8_t)~bit;
+                    }
+                    armed &= (uint8_t)~bit;
+                    long_sent &= (uint8_t)~bit;
+                    age[i] = 0;
+                }
+            } else {
+                put(INPUT_RELEASE, i);
+                if (i < INPUT_TIMED) {
+                    if (!((long_sent | second) & bit)) armed |= bit;
+                    age[i] = 0;
+                }
+            }
+        }
+    }
+
+    for (i = 0, bit = 1; i < INPUT_TIMED; i++, bit <<= 1) {
+        if ((state & ~long_sent & bit) && age[i] >= LONG_TICKS) {
+            put(INPUT_LONG, i);
+            long_sent |= bit;
+        }
+    }
+}
+
+uint8_t input_state(void) {
+    return state;
+}
@@ -0,0 +1,76 @@
+/*
+
+Digital inputs debounced together, with their changes posted as events
+
+input_tick() runs in the Timer 0 interrupt with one sample of up to 8 inputs,
+bit i = input i, 1 = active (the program inverts active-low pins). All 8 are
+debounced at once with a vertical counter: two bytes hold a 2-bit counter per
+input, and an input changes state after 4 equal samples that differ from it,
+15 to 20 ms with the 5 ms tick. That is about a dozen instructions per tick
+whatever the number of inputs, and nothing runs on Port B changes.
+
+Every change is posted to the deferred-event ring (defer.h) under the event
+type given to input_init(), its argument packing what happened and to which
+input:
+
+    INPUT_PRESS    input became active
+    INPUT_RELEASE  input became inactive
+    INPUT_LONG     still active INPUT_LONG_MS after the press, once per press
+    INPUT_DOUBLE   pressed again within INPUT_DOUBLE_MS of a short press's
+                   release; comes right after that second INPUT_PRESS
+
+Long and double presses are only tracked for inputs 0..INPUT_TIMED-1, which
+cost one byte each. INPUT_PRESS is never held back waiting for a possible
+double press, so a program that only needs presses reacts at once.
+
+A press made while the main loop is busy (a long LCD update, a delay) waits
+in the ring instead of being missed; when the ring is full the event is
+dropped and counted against its type (defer_overruns()).
+
+Example C:
+#define KEY_PIN PORTB, 0  // bits.h descriptor, low when pressed
+#define KEY 0             // input number
+enum { EV_INPUT, EV_TYPES };
+
+// Timer 0 interrupt, every 5 ms
+input_tick(pin_test(KEY_PIN) ? 0 : BIT(KEY));
+
+// handler, run by defer_dispatch() in the main loop
+void key_event(uint8_t arg) {
+    if (INPUT_NUMBER(arg) == KEY && INPUT_TYPE(arg) == INPUT_PRESS) start_stop();
+    if (INPUT_NUMBER(arg) == KEY && INPUT_TYPE(arg) == INPUT_LONG) show_menu();
+}
+
+defer_init();
+defer_register(EV_INPUT, key_event);
+input_init(EV_INPUT);
+
+*/
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+
+#define INPUT_TICK_MS 5      // input_tick() period
+#define INPUT_LONG_MS 800    // hold time of a long press
+#define INPUT_DOUBLE_MS 300  // longest release between the two presses of a double press
+#define INPUT_TIMED 1        // inputs with long and double presses, from input 0
+
+// Event types
+#define INPUT_PRESS 0
+#define INPUT_RELEASE 1
+#define INPUT_LONG 2
+#define INPUT_DOUBLE 3
+
+// Event argument
+#define INPUT_ARG(type, input) ((uint8_t)((type) << 3 | (input)))
+#define INPUT_TYPE(arg) ((arg) >> 3)
+#define INPUT_NUMBER(arg) ((arg) & 7)  // 0..7
+
+void input_init(uint8_t type);   // defer.h event type of the changes
+void input_tick(uint8_t raw);    // Timer 0 interrupt
+
+uint8_t input_state(void);  // debounced inputs, bit i = input i
+
+#endif
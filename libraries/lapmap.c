@@ -0,0 +1,225 @@
+#include "always.h"
+#include "lapmap.h"
+#include "odometry.h"
+#include "ttc.h"  // TTC_DUTY_FULL, TTC_MMPS_FULL
+
+#define FULL_TURN 65536L
+
+#if LAPMAP_BINS * LAPMAP_BIN_MM > 32767
+#error "LAPMAP_BINS * LAPMAP_BIN_MM must fit the position, int16_t"
+#endif
+
+// Learning: turn per bin, brads / 64; then the plan, profile unit / 4 (255 = no limit)
+static uint8_t plan[LAPMAP_BINS];
+static uint8_t entries[(LAPMAP_BINS + 7) / 8];  // bins where a curve starts
+static uint8_t bins;     // bins of the learned lap, 0 = none
+static char learning;    // the first lap, still inside the map
+static uint8_t lap;
+
+static int32_t origin;        // odo_distance() at the start line, moved by the curve entries
+static int32_t turned;        // brads since the start line, unwrapped
+static uint16_t last_heading;
+static int16_t last_x;
+static int16_t step;          // mm of the last tick
+static uint8_t bin;           // being driven
+static uint16_t bin_heading;  // at the start of it
+static uint8_t last_turn;     // of the bin before
+
+static int16_t grip;
+static int16_t decel;
+static int16_t full_speed = TTC_MMPS_FULL;  // mm/s at TTC_DUTY_FULL
+
+static uint16_t isqrt32(uint32_t x) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > x) bit >>= 2;
+    while (bit) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint16_t)root;
+}
+
+static int16_t position(void) {
+    int32_t p = odo_distance() - origin;
+
+    return p < 0 ? 0 : p > 32767 ? 32767 : (int16_t)p;
+}
+
+// Turned a whole number of turns, at least one; the circles made while the
+// tape was lost only add whole turns
+static char full_turns(void) {
+    int32_t t = turned < 0 ? -turned : turned;
+    int32_t rest = t % FULL_TURN;
+
+    return t >= FULL_TURN - LAPMAP_SLACK && (rest <= LAPMAP_SLACK || rest >= FULL_TURN - LAPMAP_SLACK);
+}
+
+static char is_entry(uint8_t i) {
+    return (entries[i >> 3] >> (i & 7)) & 1;
+}
+
+// v^2 = grip / curvature, curvature = turn * 64 * 2 pi / 65536 / LAPMAP_BIN_MM
+static uint8_t bin_speed(uint8_t turn) {
+    uint32_t v;
+
+    if (turn == 0) return 255;
+    v = isqrt32((uint32_t)grip * LAPMAP_BIN_MM * 163 / turn);  // 163 = 1024 / (2 pi)
+    v = v * TTC_DUTY_FULL / full_speed / 4;
+    return v > 255 ? 255 : (uint8_t)v;
+}
+
+static void make_plan(void) {
+    uint32_t brake = 2UL * decel * LAPMAP_BIN_MM / full_speed * TTC_DUTY_FULL;  // v^2 lost per bin
+    uint32_t v;
+    uint8_t i, next, k;
+
+    for (i = 0; i < bins; i++) plan[i] = bin_speed(plan[i]);
+    for (k = 0; k < 2 * bins; k++) {  // backwards, round the lap twice
+        i = (uint8_t)(bins - 1 - k % bins);
+        next = (uint8_t)((i + 1) % bins);
+        v = isqrt32((uint32_t)plan[next] * plan[next] * 16 + brake) / 4;
+        if (v < plan[i]) plan[i] = (uint8_t)v;
+    }
+}
+
+// Curve entry: the nearest one of the map within LAPMAP_SNAP_BINS is where the cart is
+static void snap(uint8_t at) {
+    uint8_t d;
+
+    for (d = 0; d <= LAPMAP_SNAP_BINS; d++) {
+        if (at >= d && at - d < bins && is_entry((uint8_t)(at - d))) {
+            origin += (int32_t)d * LAPMAP_BIN_MM;
+            return;
+        }
+        if (at + d < bins && is_entry((uint8_t)(at + d))) {
+            origin -= (int32_t)d * LAPMAP_BIN_MM;
+            return;
+        }
+    }
+}
+
+// The cart has left the current bin
+static void close_bin(uint16_t heading) {
+    int16_t d = (int16_t)(heading - bin_heading);
+    uint16_t t = (uint16_t)(d < 0 ? -(int32_t)d : d) >> 6;
+    uint8_t turn = t > 255 ? 255 : (uint8_t)t;
+    char entry = turn >= LAPMAP_ENTRY && last_turn < LAPMAP_ENTRY;
+
+    bin_heading = heading;
+    last_turn = turn;
+    if (learning) {
+        if (bin >= LAPMAP_BINS) {
+            learning = FALSE;  // too long for the map
+            return;
+        }
+        plan[bin] = turn;
+        if (entry) entries[bin >> 3] |= (uint8_t)(1 << (bin & 7));
+    } else if (bins && entry) {
+        snap(bin);
+    }
+}
+
+void lapmap_start(void) {
+    uint8_t i;
+
+    odo_init();
+    for (i = 0; i < sizeof entries; i++) entries[i] = 0;
+    bins = 0;
+    learning = TRUE;
+    lap = 0;
+    origin = 0;
+    turned = 0;
+    last_heading = 0;
+    last_x = 0;
+    step = 0;
+    bin = 0;
+    bin_heading = 0;
+    last_turn = 0;
+}
+
+void lapmap_limits(int16_t grip_mmps2, int16_t decel_per_s, int16_t full_mmps) {
+    grip = grip_mmps2;
+    decel = decel_per_s;
+    full_speed = full_mmps > 0 ? full_mmps : TTC_MMPS_FULL;
+}
+
+char lapmap_update(int16_t left, int16_t right, char lost) {
+    int32_t before = odo_distance();
+    uint16_t heading;
+    int16_t x, pos;
+    int32_t rest;
+    char new_lap = FALSE;
+
+    odo_update(left, right);
+    heading = odo_heading();
+    x = odo_x();
+    step = (int16_t)(odo_distance() - before);
+    turned += (int16_t)(heading - last_heading);
+    if (lost) bin_heading += (uint16_t)(heading - last_heading);  // searching, not a bend of the track
+    last_heading = heading;
+    pos = position();
+
+    if (full_turns() && last_x < 0 && x >= 0 && pos >= LAPMAP_MIN_MM) {  // back at the start line
+        close_bin(heading);
+        if (learning) {
+            learning = FALSE;
+            if (grip > 0) {
+                bins = (uint8_t)(bin + 1);
+                make_plan();
+            }
+        }
+        rest = ((turned < 0 ? -turned : turned) + FULL_TURN / 2) % FULL_TURN - FULL_TURN / 2;
+        turned = turned < 0 ? -rest : rest;  // off the whole turns
+        origin = odo_distance();
+        bin = 0;
+        new_lap = TRUE;
+    } else if (bins && pos >= (int16_t)((bins + LAPMAP_SNAP_BINS) * LAPMAP_BIN_MM)) {  // start line missed
+        origin += (int32_t)bins * LAPMAP_BIN_MM;
+        bin = (uint8_t)(position() / LAPMAP_BIN_MM);
+        new_lap = TRUE;
+    } else if (pos / LAPMAP_BIN_MM > bin) {
+        close_bin(heading);
+        bin = (uint8_t)(position() / LAPMAP_BIN_MM);
+    } else if (pos / LAPMAP_BIN_MM < bin) {  // backwards, pivoting
+        bin = (uint8_t)(pos / LAPMAP_BIN_MM);
+    }
+    if (new_lap && lap < 255) lap++;
+    last_x = x;
+    return new_lap;
+}
+
+int16_t lapmap_duty(int16_t duty) {
+    int16_t pos = position();
+    uint8_t i, last, limit = 255;
+
+    if (!lapmap_learned()) return duty;
+    last = (uint8_t)((pos + (int32_t)(step > 0 ? step : 0) * LAPMAP_LEAD_MS / LAPMAP_DT_MS) / LAPMAP_BIN_MM);
+    for (i = (uint8_t)(pos / LAPMAP_BIN_MM); i <= last; i++) {
+        if (plan[i % bins] < limit) limit = plan[i % bins];
+    }
+    if (limit == 255 || duty <= 4 * limit) return duty;
+    return (int16_t)(4 * limit);
+}
+
+uint8_t lapmap_lap(void) {
+    return lap;
+}
+
+char lapmap_learned(void) {
+    return bins != 0;
+}
+
+int16_t lapmap_position(void) {
+    return position();
+}
+
+int16_t lapmap_length(void) {
+    return (int16_t)(bins * LAPMAP_BIN_MM);
+}
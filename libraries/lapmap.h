@@ -0,0 +1,72 @@
+/*
+
+Lap learning: a map of the track from the first lap, speeds planned ahead
+
+The line follower only sees the tape under its three sensors, so it enters
+every bend at full speed and slows once the tape has already moved off the
+centre. The track is the same at every lap, though. During the first lap
+the map keeps, for every LAPMAP_BIN_MM of distance from the encoders, how
+far the cart turned; the lap is over when the cart has turned a full turn
+and crosses the line it started on again (odometry.h, x back to 0). Circles
+made while the tape was lost only add whole turns, so they do not hide the
+end of the lap; the turn made while lost is not a bend of the track and is
+left out of the map and of the curve entries.
+
+The map then becomes a speed plan, once, in the profile's unit, where
+TTC_DUTY_FULL is the full_mmps given to lapmap_limits() (the measured top
+speed of ffwd.h, or TTC_MMPS_FULL):
+
+    in a bin    the speed of the lateral acceleration grip, mm/s^2,
+                at the bin's curvature: v^2 = grip / curvature
+    before it   no faster than braking at the deceleration limit leaves
+                time for, taken round the lap twice so the last bins
+                brake for the first bend
+
+From the second lap on, lapmap_duty() gives the lowest speed of the plan
+from here to LAPMAP_LEAD_MS ahead, which covers the lag of the ramps and
+the motors, so the cart slows before a bend and takes the straights at the
+top speed. The position in the lap is aligned twice: at the start line,
+and at every curve entry (a bin that turns LAPMAP_ENTRY after one that did
+not) that is within LAPMAP_SNAP_BINS of one in the map.
+
+The map takes LAPMAP_BINS bytes of RAM and is lost at the next
+lapmap_start(), so each run learns again from where it starts; a lap longer
+than the map is driven without a plan. Everything is integer, and the
+module builds on the host for tools/tracksim.c.
+
+Example C:
+// key press
+lapmap_limits(param[P_GRIP], param[P_DECEL], full_mmps);  // mm/s^2, duty/s, mm/s
+lapmap_start();                                          // the start line is here
+
+// every control tick
+lapmap_update(count_left - last_left, count_right - last_right, line_lost);
+duty_cycle = lapmap_duty(ttc_duty_limit(param[P_DUTY_MAX]));
+
+*/
+
+#ifndef LAPMAP_H
+#define LAPMAP_H
+
+#include <stdint.h>
+
+#define LAPMAP_DT_MS 40       // lapmap_update() period
+#define LAPMAP_BIN_MM 128     // distance per map entry
+#define LAPMAP_BINS 48        // laps up to 6.1 m
+#define LAPMAP_MIN_MM 1000    // shortest lap
+#define LAPMAP_SLACK 8192     // brads: a lap turns at least a full turn less 45 degrees
+#define LAPMAP_ENTRY 16       // turn in a bin that makes a curve, brads / 64 (5.6 degrees)
+#define LAPMAP_SNAP_BINS 2    // curve entries this close are the same one
+#define LAPMAP_LEAD_MS 240    // plan looked at this far ahead
+
+void lapmap_start(void);  // at the start of a run, odometry included
+void lapmap_limits(int16_t grip_mmps2, int16_t decel, int16_t full_mmps);  // grip 0 = no plan
+char lapmap_update(int16_t left, int16_t right, char lost);  // counts of the tick, line lost; TRUE: new lap
+int16_t lapmap_duty(int16_t duty);  // at most duty, slower where the plan says so
+
+uint8_t lapmap_lap(void);         // laps completed, saturating
+char lapmap_learned(void);        // the plan is in use
+int16_t lapmap_position(void);    // mm since the start line
+int16_t lapmap_length(void);      // mm, of the learned lap in whole bins; 0 = not yet
+
+#endif
@@ -0,0 +1,392 @@
+#include "link.h"
+
+#ifdef __XC8
+#include <xc.h>
+#endif
+
+#define PEER_TX_SYNCED 0x01  // the peer acknowledged our SYN
+#define PEER_RX_SYNCED 0x02  // we took the peer's SYN
+
+#define SEQ(ctrl) ((ctrl) & 0x07)
+#define TYPE(ctrl) ((ctrl) & 0xC0)
+
+// Frame buffer layout
+#define F_DST 0
+#define F_SRC 1
+#define F_CTRL 2
+#define F_LEN 3
+#define F_DATA 4
+
+static uint16_t crc_byte(uint16_t crc, uint8_t c) {
+    uint8_t i;
+
+    crc ^= (uint16_t)c << 8;
+    for (i = 0; i < 8; i++) {
+        crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+static struct link_peer *find_peer(struct link *lk, uint8_t addr) {
+    struct link_peer *p;
+    uint8_t i;
+
+    for (i = 0; i < LINK_PEERS; i++) {
+        if (lk->peers[i].addr == addr) return &lk->peers[i];
+    }
+
+    // Unknown: take a free entry, or the next one in turn
+    for (i = 0; i < LINK_PEERS; i++) {
+        if (lk->peers[i].addr == 0) break;
+    }
+    if (i == LINK_PEERS) {
+        i = lk->next_peer;
+        lk->next_peer = (uint8_t)((lk->next_peer + 1) % LINK_PEERS);
+    }
+    p = &lk->peers[i];
+    p->addr = addr;
+    p->tx_seq = 0;
+    p->rx_base = 0;
+    p->rx_mask = 0;
+    p->flags = 0;
+    return p;
+}
+
+void link_init(struct link *lk, struct link_io *io, uint8_t addr) {
+    uint8_t i;
+
+    lk->addr = addr;
+    lk->io = io;
+    io->rx_head = io->rx_tail = 0;
+    io->tx_head = io->tx_tail = 0;
+    io->quiet = 0xFF;
+    io->overruns = 0;
+    lk->pos = 0;
+    lk->acks = 0;
+    lk->in_len = 0xFF;
+    lk->quiet_ms = LINK_QUIET_MS;
+    lk->random = addr | 1;
+    lk->backoff = 1;
+    lk->next_peer = 0;
+    lk->next_slot = 0;
+    lk->crc_errors = lk->retransmits = lk->failures = 0;
+    for (i = 0; i < LINK_PEERS; i++) lk->peers[i].addr = 0;
+    for (i = 0; i < LINK_WINDOW; i++) lk->slots[i].dst = 0;
+
+#ifdef __XC8
+    RCIE = 1;  // receive interrupt; transmit is enabled by link_tx_start()
+    PEIE = 1;
+#endif
+}
+
+#ifdef __XC8
+void link_tx_start(struct link *lk) {
+    (void)lk;
+    TXIE = 1;
+}
+#endif
+
+char link_send(struct link *lk, uint8_t dst, const uint8_t *data, uint8_t len) {
+    struct link_slot *slot = 0;
+    struct link_peer *peer;
+    uint8_t i, n, next = 0;
+
+    if (len > LINK_MAX_PAYLOAD || dst == 0) return 0;
+
+    // Slots are taken in turn, so link_poll() sends them oldest first
+    for (i = 0; i < LINK_WINDOW; i++) {
+        n = (uint8_t)((lk->next_slot + i) % LINK_WINDOW);
+        if (lk->slots[n].dst == 0) {
+            if (!slot) {
+                slot = &lk->slots[n];
+                next = (uint8_t)((n + 1) % LINK_WINDOW);
+            }
+        } else if (lk->slots[n].dst == dst && (lk->slots[n].ctrl & LINK_SYN)) {
+            return 0;  // the SYN to this peer is still waiting for its ack
+        }
+    }
+    if (!slot) return 0;  // window full
+
+    if (dst == LINK_BROADCAST) {
+        slot->ctrl = LINK_BCAST;
+    } else {
+        peer = find_peer(lk, dst);
+        for (i = 0; i < LINK_WINDOW; i++) {
+            if (lk->slots[i].dst != dst) continue;
+            if (!(peer->flags & PEER_TX_SYNCED)) return 0;  // SYN goes alone
+            // Never more than LINK_WINDOW past the oldest unacknowledged frame,
+            // or the receiver would take the new one for a duplicate
+            if (((peer->tx_seq - SEQ(lk->slots[i].ctrl)) & 0x07) >= LINK_WINDOW) return 0;
+        }
+        slot->ctrl = (uint8_t)(LINK_DATA | peer->tx_seq | ((peer->flags & PEER_TX_SYNCED) ? 0 : LINK_SYN));
+        peer->tx_seq = (uint8_t)((peer->tx_seq + 1) & 0x07);
+    }
+
+    slot->dst = dst;
+    slot->len = len;
+    slot->tries = 0;
+    slot->timer = 0;  // due now
+    for (i = 0; i < len; i++) slot->data[i] = data[i];
+    lk->next_slot = next;
+    return 1;
+}
+
+int link_recv(struct link *lk, uint8_t *src, uint8_t *data) {
+    uint8_t i, len = lk->in_len;
+
+    if (len == 0xFF) return -1;
+    *src = lk->in_src;
+    for (i = 0; i < len; i++) data[i] = lk->in_data[i];
+    lk->in_len = 0xFF;
+    return len;
+}
+
+static char deliver(struct link *lk) {
+    uint8_t i;
+
+    if (lk->in_len != 0xFF) return 0;  // previous frame not read yet
+    lk->in_src = lk->frame[F_SRC];
+    for (i = 0; i < lk->frame[F_LEN]; i++) lk->in_data[i] = lk->frame[F_DATA + i];
+    lk->in_len = lk->frame[F_LEN];
+    return 1;
+}
+
+static void queue_ack(struct link *lk, uint8_t dst, uint8_t seq) {
+    if (lk->acks >= LINK_ACKS) return;  // the sender will retry
+    lk->ack_dst[lk->acks] = dst;
+    lk->ack_ctrl[lk->acks] = (uint8_t)(LINK_ACK | seq);
+    lk->acks++;
+}
+
+static void handle_frame(struct link *lk) {
+    uint8_t ctrl = lk->frame[F_CTRL];
+    uint8_t src = lk->frame[F_SRC];
+    uint8_t seq = SEQ(ctrl);
+    uint8_t i, d;
+    struct link_peer *peer;
+
+    if (lk->frame[F_DST] != lk->addr && lk->frame[F_DST] != LINK_BROADCAST) return;
+
+    switch (TYPE(ctrl)) {
+    case LINK_ACK:
+        for (i = 0; i < LINK_WINDOW; i++) {
+            struct link_slot *slot = &lk->slots[i];
+            if (slot->dst == src && TYPE(slot->ctrl) == LINK_DATA && SEQ(slot->ctrl) == seq && slot->tries) {
+                if (slot->ctrl & LINK_SYN) find_peer(lk, src)->flags |= PEER_TX_SYNCED;
+                slot->dst = 0;
+            }
+        }
+        break;
+
+    case LINK_BCAST:
+        deliver(lk);
+        break;
+
+    case LINK_DATA:
+        peer = find_peer(lk, src);
+        if (ctrl & LINK_SYN) {
+            if ((peer->flags & PEER_RX_SYNCED) && seq == ((peer->rx_base - 1) & 0x07) && peer->rx_mask == 0) {
+                queue_ack(lk, src, seq);  // our ack of the SYN was lost
+                return;
+            }
+            peer->rx_base = seq;
+            peer->rx_mask = 0;
+            peer->flags |= PEER_RX_SYNCED;
+        } else if (!(peer->flags & PEER_RX_SYNCED)) {
+            peer->rx_base = seq;  // we restarted, the sender did not
+            peer->rx_mask = 0;
+            peer->flags |= PEER_RX_SYNCED;
+        }
+
+        d = (uint8_t)((seq - peer->rx_base) & 0x07);
+        if (d >= LINK_WINDOW || (peer->rx_mask & (1 << d))) {
+            queue_ack(lk, src, seq);  // duplicate
+            return;
+        }
+        if (!deliver(lk)) return;  // no room: no ack, it will be resent
+        peer->rx_mask |= (uint8_t)(1 << d);
+        while (peer->rx_mask & 1) {
+            peer->rx_mask >>= 1;
+            peer->rx_base = (uint8_t)((peer->rx_base + 1) & 0x07);
+        }
+        queue_ack(lk, src, seq);
+        break;
+    }
+}
+
+static void parse(struct link *lk, uint8_t c) {
+    uint8_t i, n, count;
+    uint16_t crc;
+
+    if (lk->pos == 0) {  // hunting for the start of a frame
+        if (c == LINK_SOF) lk->pos = 1;
+        return;
+    }
+
+    // pos - 1 bytes of the frame are stored
+    lk->frame[lk->pos - 1] = c;
+    count = lk->pos++;
+
+    if (count <= F_LEN) return;  // header not complete
+    if (lk->frame[F_LEN] > LINK_MAX_PAYLOAD) {
+        lk->pos = 0;  // not a frame, resynchronize
+        return;
+    }
+    n = (uint8_t)(F_DATA + lk->frame[F_LEN]);
+    if (count < n + 2) return;
+
+    // Complete frame
+    lk->pos = 0;
+    crc = 0xFFFF;
+    for (i = 0; i < n; i++) crc = crc_byte(crc, lk->frame[i]);
+    if ((uint8_t)(crc >> 8) != lk->frame[n] || (uint8_t)crc != lk->frame[n + 1]) {
+        lk->crc_errors++;
+        return;
+    }
+    handle_frame(lk);
+}
+
+static uint8_t tx_free(struct link_io *io) {
+    return (uint8_t)((io->tx_tail - io->tx_head - 1) & (LINK_TX_RING - 1));
+}
+
+static void put_frame(struct link *lk, uint8_t dst, uint8_t ctrl, uint8_t len, const uint8_t *data) {
+    struct link_io *io = lk->io;
+    uint8_t header[4];
+    uint16_t crc = 0xFFFF;
+    uint8_t i, c;
+
+    header[0] = dst;
+    header[1] = lk->addr;
+    header[2] = ctrl;
+    header[3] = len;
+
+    io->tx_ring[io->tx_head] = LINK_SOF;
+    io->tx_head = (io->tx_head + 1) & (LINK_TX_RING - 1);
+    for (i = 0; i < 4 + len; i++) {
+        c = i < 4 ? header[i] : data[i - 4];
+        crc = crc_byte(crc, c);
+        io->tx_ring[io->tx_head] = c;
+        io->tx_head = (io->tx_head + 1) & (LINK_TX_RING - 1);
+    }
+    io->tx_ring[io->tx_head] = (uint8_t)(crc >> 8);
+    io->tx_head = (io->tx_head + 1) & (LINK_TX_RING - 1);
+    io->tx_ring[io->tx_head] = (uint8_t)crc;
+    io->tx_head = (io->tx_head + 1) & (LINK_TX_RING - 1);
+}
+
+// Drops every frame to a peer that stopped answering. The next frame carries
+// SYN, so the receiver does not wait forever for the sequence numbers lost.
+static void give_up(struct link *lk, uint8_t dst) {
+    uint8_t i;
+
+    for (i = 0; i < LINK_WINDOW; i++) {
+        if (lk->slots[i].dst == dst) {
+            lk->slots[i].dst = 0;
+            lk->failures++;
+        }
+    }
+    find_peer(lk, dst)->flags &= (uint8_t)~PEER_TX_SYNCED;
+}
+
+void link_poll(struct link *lk) {
+    struct link_io *io = lk->io;
+    uint8_t i, n, sent = 0;
+    struct link_slot *slot;
+
+    // Received bytes
+    while (io->rx_tail != io->rx_head) {
+        parse(lk, io->rx_ring[io->rx_tail]);
+        io->rx_tail = (io->rx_tail + 1) & (LINK_RX_RING - 1);
+    }
+
+    // Start new frames only on a quiet line, and not inside one being sent.
+    // Acks go first; data frames wait a further random 1..8 ms, drawn again
+    // while the line is busy, so waiting nodes do not all start together.
+    if (io->tx_head != io->tx_tail || lk->pos != 0) return;
+    if (io->quiet < lk->quiet_ms) {
+        lk->random = (uint8_t)((lk->random >> 1) ^ (-(lk->random & 1) & 0xB8));  // 8-bit LFSR
+        lk->backoff = (uint8_t)((lk->random & 0x07) + 1);
+        return;
+    }
+
+    while (lk->acks && tx_free(io) >= LINK_OVERHEAD) {
+        lk->acks--;
+        put_frame(lk, lk->ack_dst[lk->acks], lk->ack_ctrl[lk->acks], 0, 0);
+        sent = 1;
+    }
+
+    if (lk->quiet_ms && io->quiet < lk->quiet_ms + lk->backoff) {
+        if (sent) link_tx_start(lk);
+        return;
+    }
+
+    for (i = 0; i < LINK_WINDOW; i++) {
+        n = (uint8_t)((lk->next_slot + i) % LINK_WINDOW);
+        slot = &lk->slots[n];
+        if (slot->dst == 0 || slot->timer != 0) continue;
+        if (slot->tries > LINK_RETRIES) {
+            give_up(lk, slot->dst);
+            continue;
+        }
+        if (tx_free(io) < LINK_OVERHEAD + slot->len) break;
+
+        put_frame(lk, slot->dst, slot->ctrl, slot->len, slot->data);
+        sent = 1;
+        if (TYPE(slot->ctrl) == LINK_BCAST) {
+            slot->dst = 0;  // sent once, never acknowledged
+            continue;
+        }
+        if (slot->tries) lk->retransmits++;
+        slot->tries++;
+        // Spread retransmissions of different nodes apart
+        slot->timer = LINK_RTO_MS + ((lk->addr * 5 + slot->tries * 7 + n * 3) & 0x0F);
+    }
+
+    if (sent) link_tx_start(lk);
+}
+
+void link_tick(struct link *lk, uint16_t ms) {
+    uint8_t i;
+    struct link_slot *slot;
+
+    lk->io->quiet = (uint8_t)(ms >= 255 - lk->io->quiet ? 255 : lk->io->quiet + ms);
+
+    if (lk->pos != 0 && lk->io->quiet > 10) lk->pos = 0;  // frame cut short
+
+    for (i = 0; i < LINK_WINDOW; i++) {
+        slot = &lk->slots[i];
+        if (slot->dst == 0 || slot->timer == 0) continue;
+        slot->timer = slot->timer > ms ? slot->timer - ms : 0;
+    }
+}
+
+char link_idle(struct link *lk) {
+    uint8_t i;
+
+    for (i = 0; i < LINK_WINDOW; i++) {
+        if (lk->slots[i].dst) return 0;
+    }
+    return lk->acks == 0 && lk->io->tx_head == lk->io->tx_tail;
+}
+
+void link_rx_byte(struct link_io *io, uint8_t c) {
+    uint8_t next = (io->rx_head + 1) & (LINK_RX_RING - 1);
+
+    io->quiet = 0;
+    if (next == io->rx_tail) {
+        io->overruns++;
+        return;
+    }
+    io->rx_ring[io->rx_head] = c;
+    io->rx_head = next;
+}
+
+int link_tx_next(struct link_io *io) {
+    uint8_t c;
+
+    if (io->tx_tail == io->tx_head) return -1;
+    c = io->tx_ring[io->tx_tail];
+    io->tx_tail = (io->tx_tail + 1) & (LINK_TX_RING - 1);
+    return c;
+}
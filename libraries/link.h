@@ -0,0 +1,177 @@
+/*
+
+Addressed, acknowledged packet link over the USART
+
+Frame:
+    0x7E  dst  src  ctrl  len  payload[len]  crc_hi  crc_lo
+
+    dst/src  node addresses 1..254, LINK_BROADCAST = every node
+    ctrl     bits 7..6 type (data, ack, broadcast), bit 3 SYN, bits 2..0 seq
+    crc      CRC-16/CCITT over dst..payload
+
+Data frames are acknowledged one by one (selective acknowledgement) and
+resent after LINK_RTO_MS until acknowledged or LINK_RETRIES is reached. Up to
+LINK_WINDOW frames may be in flight; sequence numbers are 3 bits per peer,
+which is the largest window selective repeat allows. The receiver keeps a
+window per peer to drop duplicates, so every frame is delivered once. A frame
+retransmitted after a loss can arrive after a later one. The first frame to
+a peer carries SYN and is sent alone, so both ends agree on the sequence
+after either one resets. Broadcast frames are neither acknowledged nor
+repeated. A peer that misses LINK_RETRIES retransmissions is given up: its
+frames in flight are dropped (counted in failures) and the next one carries
+SYN again.
+
+On a shared half-duplex line a node starts a frame only after LINK_QUIET_MS
+without received bytes, plus a random 1..8 ms for data frames. On a full
+duplex point-to-point wire set quiet_ms = 0 after link_init() to send at
+once.
+
+The interrupt only moves single bytes between the USART and two rings,
+a bounded handful of instructions per byte:
+
+    if (RCIE && RCIF) {
+        if (OERR) { CREN = 0; CREN = 1; }  // clear a receive overrun
+        link_rx_byte(&node_io, RCREG);
+    }
+    if (TXIE && TXIF) {
+        int c = link_tx_next(&node_io);
+        if (c < 0) TXIE = 0; else TXREG = (uint8_t)c;
+    }
+
+Parsing, CRC, acknowledgements and retransmission run in link_poll() from
+the main loop, with link_tick() giving it the elapsed time.
+
+The state is in two structs, so the host simulation (tools/linksim.c) can
+run several nodes in one program; on the PIC there is just one of each:
+
+    struct link node;        // frames, peers and slots, main loop only
+    struct link_io node_io;  // the rings and what the interrupt touches
+    link_init(&node, &node_io, 1);
+
+The PIC16F886 cannot place an object across a RAM bank, so each must stay
+within 96 bytes: with the defaults below struct link takes 82 and struct
+link_io 39. tools/memory_report.py lists any object that does not fit.
+
+*/
+
+#ifndef LINK_H
+#define LINK_H
+
+#include <stdint.h>
+
+#define LINK_BROADCAST 0xFF
+#define LINK_MAX_PAYLOAD 8
+#ifndef LINK_WINDOW
+#define LINK_WINDOW 2      // frames in flight, at most 4 with 3-bit sequence numbers
+#endif
+#ifndef LINK_PEERS
+#define LINK_PEERS 2       // nodes remembered for sequence numbers
+#endif
+#ifndef LINK_ACKS
+#define LINK_ACKS 2        // acknowledgements waiting to be sent
+#endif
+#ifndef LINK_RX_RING
+#define LINK_RX_RING 16    // power of 2
+#endif
+#ifndef LINK_TX_RING
+#define LINK_TX_RING 16    // power of 2, must hold the largest frame
+#endif
+#define LINK_RTO_MS 50     // retransmission timeout
+#define LINK_RETRIES 5
+#define LINK_QUIET_MS 2    // line must be idle this long before a frame starts
+
+#define LINK_SOF 0x7E
+#define LINK_OVERHEAD 7    // SOF, dst, src, ctrl, len, crc
+
+// Frame types
+#define LINK_DATA 0x00
+#define LINK_ACK 0x40
+#define LINK_BCAST 0x80
+#define LINK_SYN 0x08
+
+#if LINK_WINDOW > 4
+#error "LINK_WINDOW: at most 4 frames in flight with 3-bit sequence numbers"
+#endif
+#if LINK_TX_RING - 1 < LINK_OVERHEAD + LINK_MAX_PAYLOAD
+#error "LINK_TX_RING: a ring of n bytes holds n - 1, less than the largest frame"
+#endif
+
+struct link_peer {
+    uint8_t addr;     // 0 = unused
+    uint8_t tx_seq;   // next sequence number to send
+    uint8_t rx_base;  // oldest sequence number not yet received
+    uint8_t rx_mask;  // received frames after rx_base, bit i = rx_base + i
+    uint8_t flags;
+};
+
+struct link_slot {
+    uint8_t dst;  // 0 = free
+    uint8_t ctrl;
+    uint8_t len;
+    uint8_t tries;
+    uint16_t timer;  // ms until the next retransmission
+    uint8_t data[LINK_MAX_PAYLOAD];
+};
+
+// Written by the interrupt: received bytes, bytes to send, line activity
+struct link_io {
+    // Bytes from the ISR to link_poll()
+    volatile uint8_t rx_ring[LINK_RX_RING];
+    volatile uint8_t rx_head;
+    volatile uint8_t rx_tail;
+
+    // Bytes from link_poll() to the ISR
+    volatile uint8_t tx_ring[LINK_TX_RING];
+    volatile uint8_t tx_head;
+    volatile uint8_t tx_tail;
+
+    volatile uint8_t quiet;      // ms since the last received byte
+    volatile uint16_t overruns;  // bytes lost because the receive ring was full
+};
+
+struct link {
+    uint8_t addr;
+    struct link_io *io;
+
+    // Frame being received
+    uint8_t frame[LINK_OVERHEAD - 3 + LINK_MAX_PAYLOAD + 2];
+    uint8_t pos;
+
+    struct link_peer peers[LINK_PEERS];
+    struct link_slot slots[LINK_WINDOW];
+    uint8_t ack_dst[LINK_ACKS];
+    uint8_t ack_ctrl[LINK_ACKS];
+    uint8_t acks;
+
+    // Delivered frame waiting for link_recv()
+    uint8_t in_src;
+    uint8_t in_len;  // 0xFF = empty
+    uint8_t in_data[LINK_MAX_PAYLOAD];
+
+    uint8_t quiet_ms;   // idle time before sending, LINK_QUIET_MS by default
+    uint8_t random;     // backoff generator
+    uint8_t backoff;    // extra ms of idle line before a data frame
+    uint8_t next_peer;  // peer entry to replace next
+    uint8_t next_slot;  // slot to take next, the oldest one in use
+
+    // Statistics
+    uint16_t crc_errors;
+    uint16_t retransmits;
+    uint16_t failures;  // frames given up after LINK_RETRIES
+};
+
+void link_init(struct link *lk, struct link_io *io, uint8_t addr);
+char link_send(struct link *lk, uint8_t dst, const uint8_t *data, uint8_t len);
+int link_recv(struct link *lk, uint8_t *src, uint8_t *data);
+void link_poll(struct link *lk);
+void link_tick(struct link *lk, uint16_t ms);
+char link_idle(struct link *lk);
+
+// Interrupt side
+void link_rx_byte(struct link_io *io, uint8_t c);
+int link_tx_next(struct link_io *io);
+
+// Starts transmission of the TX ring; XC8: TXIE = 1, host: simulation hook
+void link_tx_start(struct link *lk);
+
+#endif
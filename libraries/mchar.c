@@ -0,0 +1,164 @@
+#include <stdio.h>
+
+#include "always.h"
+#include "ffwd.h"
+#include "mchar.h"
+
+#define SAMPLES_PER_S (1000 / MCHAR_DT_MS)
+
+static int16_t speed[2][MCHAR_STEPS];   // steady speed per step, counts/s
+static uint8_t delta[2][MCHAR_HOLD];    // counts per sample during the step
+static int16_t last[2];
+static uint8_t step;
+static uint8_t sample;
+static char running = FALSE;
+
+static int16_t step_duty(uint8_t k) {
+    int16_t duty = (int16_t)k * MCHAR_DUTY_STEP;
+    return duty > FFWD_DUTY_MAX ? FFWD_DUTY_MAX : duty;
+}
+
+void mchar_start(void) {
+    step = 0;
+    sample = 0;
+    running = TRUE;
+    last[0] = last[1] = 0;
+}
+
+char mchar_running(void) {
+    return running;
+}
+
+// Time to cover MCHAR_RISE_PCT % of the change from the previous step, -1 if none
+static int16_t rise_ms(uint8_t c) {
+    int16_t from = step ? speed[c][step - 1] : 0;
+    int16_t to = speed[c][step];
+    int16_t level = from + (int16_t)((int32_t)(to - from) * MCHAR_RISE_PCT / 100);
+    uint8_t j;
+
+    if (to - from < MCHAR_MOVING) return -1;
+    for (j = 0; j < MCHAR_HOLD; j++) {
+        if ((int16_t)delta[c][j] * SAMPLES_PER_S >= level) return (int16_t)(j + 1) * MCHAR_DT_MS;
+    }
+    return -1;
+}
+
+// Least squares line speed = gain * (duty - dead) through the moving steps
+static char fit(uint8_t c, int16_t *dead, int16_t *gain_q8) {
+    int32_t sx = 0, sy = 0, sxx = 0, sxy = 0;
+    int32_t n = 0;
+    uint8_t k;
+
+    for (k = 0; k < MCHAR_STEPS; k++) {
+        if (speed[c][k] <= MCHAR_MOVING) continue;
+        sx += step_duty(k);
+        sy += speed[c][k];
+        sxx += (int32_t)step_duty(k) * step_duty(k);
+        sxy += (int32_t)step_duty(k) * speed[c][k];
+        n++;
+    }
+    if (n < 2) return FALSE;
+    sxx = sxx - sx * sx / n;    // n times the variances
+    sxy = sxy - sx * (sy / n);  // sx * sy would overflow
+    if (sxx < 256 || sxy <= 0) return FALSE;
+    sxy /= sxx >> 8;
+    *gain_q8 = (int16_t)(sxy > 32767 ? 32767 : sxy);
+    *dead = (int16_t)((sx - sy * 256 / *gain_q8) / n);
+    if (*dead < 0) *dead = 0;
+    return TRUE;
+}
+
+// Duty cycle for speed v on wheel c, from the measured steps
+static int16_t duty_for(uint8_t c, int16_t v, int16_t dead) {
+    int16_t d0 = dead, v0 = 0;
+    uint8_t k;
+
+    for (k = 0; k < MCHAR_STEPS; k++) {
+        if (speed[c][k] <= MCHAR_MOVING || step_duty(k) <= d0) continue;
+        if (speed[c][k] >= v) {
+            if (speed[c][k] == v0) return step_duty(k);
+            return d0 + (int16_t)((int32_t)(v - v0) * (step_duty(k) - d0) / (speed[c][k] - v0));
+        }
+        d0 = step_duty(k);
+        v0 = speed[c][k];
+    }
+    return FFWD_DUTY_MAX;
+}
+
+static void finish(void) {
+    int16_t table[2][FFWD_POINTS];
+    int16_t dead, gain, top;
+    uint8_t c, k, i;
+
+    running = FALSE;
+
+    for (c = 0; c < 2; c++) {
+        for (k = 1; k < MCHAR_STEPS; k++) {  // a curve that never goes down
+            if (speed[c][k] < speed[c][k - 1]) speed[c][k] = speed[c][k - 1];
+        }
+    }
+    top = speed[0][MCHAR_STEPS - 1] < speed[1][MCHAR_STEPS - 1] ? speed[0][MCHAR_STEPS - 1] : speed[1][MCHAR_STEPS - 1];
+
+    for (c = 0; c < 2; c++) {
+        if (!fit(c, &dead, &gain) || top <= MCHAR_MOVING) {
+            printf("ERR\n");
+            return;
+        }
+        printf("F,%d,%d,%d\n", c + 1, dead, gain);
+        table[c][0] = dead;
+        for (i = 1; i < FFWD_POINTS; i++) {
+            table[c][i] = duty_for(c, (int16_t)((int32_t)top * i / (FFWD_POINTS - 1)), dead);
+        }
+        printf("T,%d", c + 1);
+        for (i = 0; i < FFWD_POINTS; i++) printf(",%d", table[c][i]);
+        printf("\n");
+    }
+    printf("V,%d\n", top);
+
+    ffwd_set(table, top);
+    ffwd_save();
+    printf("END\n");
+}
+
+char mchar_step(int16_t count1, int16_t count2, int16_t *duty1, int16_t *duty2) {
+    int16_t d[2];
+    int16_t sum;
+    uint8_t c, j;
+
+    if (!running) {
+        *duty1 = *duty2 = 0;
+        return FALSE;
+    }
+
+    d[0] = count1 - last[0];
+    d[1] = count2 - last[1];
+    last[0] = count1;
+    last[1] = count2;
+
+    if (sample > 0) {  // the first call only takes the starting counts
+        for (c = 0; c < 2; c++) {
+            if (d[c] < 0) d[c] = -d[c];
+            delta[c][sample - 1] = (uint8_t)(d[c] > 255 ? 255 : d[c]);
+        }
+    }
+
+    if (sample == MCHAR_HOLD) {  // step complete
+        for (c = 0; c < 2; c++) {
+            sum = 0;
+            for (j = MCHAR_HOLD - MCHAR_AVERAGE; j < MCHAR_HOLD; j++) sum += delta[c][j];
+            speed[c][step] = (int16_t)((int32_t)sum * SAMPLES_PER_S / MCHAR_AVERAGE);
+        }
+        printf("S,%d,%d,%d,%d,%d\n", step_duty(step), speed[0][step], speed[1][step], rise_ms(0), rise_ms(1));
+        sample = 1;
+        if (++step == MCHAR_STEPS) {
+            finish();
+            *duty1 = *duty2 = 0;
+            return FALSE;
+        }
+    } else {
+        sample++;
+    }
+
+    *duty1 = *duty2 = step_duty(step);
+    return TRUE;
+}
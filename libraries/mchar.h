@@ -0,0 +1,63 @@
+/*
+
+Motor characterization: dead band, gain and feed-forward table of each wheel
+
+Steps both motors together through the duty range, 0 to 1023 in
+MCHAR_DUTY_STEP steps, holding each step MCHAR_HOLD samples. At each step it
+measures, from the encoder counts, the steady speed of each wheel (average of
+the last MCHAR_AVERAGE samples) and the rise time (until the speed covers
+MCHAR_RISE_PCT % of the change from the previous step). At the end it fits,
+for each wheel, a straight line speed = gain * (duty - dead band) through
+the steps where the wheel turned, and builds the feed-forward table
+(ffwd.h): the duty cycle for 9 speeds up to the top speed both wheels can
+reach. The table is applied at once and saved to EEPROM.
+
+Put the cart on a stand with both wheels free: a run takes about 9 s and
+ends at full speed.
+
+Results are printed as they come, one line each, for tools/ffwd_plot.py:
+
+    S,duty,speed1,speed2,rise1_ms,rise2_ms    each step; speeds in X4 counts/s,
+                                              rise -1 if the speed barely changed
+    F,wheel,dead_band,gain_q8                 fit; gain in counts/s per duty, Q8
+    T,wheel,duty0,...,duty8                   feed-forward table
+    V,top_speed                               counts/s at FFWD_FULL
+    END                                       or "ERR" if a wheel did not turn
+
+mchar_step() runs every MCHAR_DT_MS with the encoder counts, and returns
+the duty cycles to apply. Wheel 1 and 2 are the motors on PWM channels 1 and
+2, as in ffwd_duty(): count1 must be the encoder of the wheel channel 1
+drives, which on the cart is encoder 2 (right wheel), and count2 encoder 1
+(left wheel).
+
+Example C:
+#define ENC_RIGHT 2  // channel 1
+#define ENC_LEFT 1   // channel 2
+if (command == 'C') mchar_start();
+if (mchar_running() && sample_tick) {
+    sample_tick = 0;
+    mchar_step(enc_count(ENC_RIGHT), enc_count(ENC_LEFT), &duty1, &duty2);
+    pwm_set(1, duty1);
+    pwm_set(2, duty2);
+}
+
+*/
+
+#ifndef MCHAR_H
+#define MCHAR_H
+
+#include <stdint.h>
+
+#define MCHAR_DT_MS 20
+#define MCHAR_DUTY_STEP 64
+#define MCHAR_STEPS 17     // 0, 64, ..., 1023
+#define MCHAR_HOLD 25      // samples per step, 500 ms
+#define MCHAR_AVERAGE 10   // last samples of a step averaged for its speed
+#define MCHAR_MOVING 20    // counts/s, slower is standing still
+#define MCHAR_RISE_PCT 90
+
+void mchar_start(void);
+char mchar_running(void);
+char mchar_step(int16_t count1, int16_t count2, int16_t *duty1, int16_t *duty2);  // FALSE once done
+
+#endif
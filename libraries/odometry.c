@@ -0,0 +1,56 @@
+#include "odometry.h"
+
+#include "trig.h"
+
+static uint32_t theta;   // heading, 2^32 = full turn
+static int32_t x_q8;     // position in mm * 256
+static int32_t y_q8;
+static int32_t dist_q8;  // travelled distance in mm * 256
+
+void odo_init(void) {
+    odo_reset(0, 0, 0);
+}
+
+void odo_reset(int16_t x_mm, int16_t y_mm, uint16_t heading) {
+    x_q8 = (int32_t)x_mm * 256;
+    y_q8 = (int32_t)y_mm * 256;
+    theta = (uint32_t)heading << 16;
+    dist_q8 = 0;
+}
+
+void odo_update(int16_t left, int16_t right) {
+    // Heading change; unsigned arithmetic wraps around the full turn
+    uint32_t dtheta = (uint32_t)(int32_t)(right - left) * ODO_HEADING_GAIN;
+
+    // Move along the heading at the middle of the interval
+    uint16_t mid = (uint16_t)((theta + (uint32_t)((int32_t)dtheta / 2)) >> 16);
+
+    int32_t ds = ((int32_t)left + right) * ODO_MM_PER_PULSE_Q8 / 2;
+
+    x_q8 += (ds * icos(mid)) >> 14;
+    y_q8 += (ds * isin(mid)) >> 14;
+    dist_q8 += ds;
+    theta += dtheta;
+}
+
+void odo_compass(uint16_t heading) {
+    // Complementary filter: encoders for the short term, compass for drift
+    int16_t err = (int16_t)(heading - (uint16_t)(theta >> 16));
+    theta += (uint32_t)((int32_t)err * (1L << (16 - ODO_COMPASS_SHIFT)));
+}
+
+int16_t odo_x(void) {
+    return (int16_t)(x_q8 >> 8);
+}
+
+int16_t odo_y(void) {
+    return (int16_t)(y_q8 >> 8);
+}
+
+int32_t odo_distance(void) {
+    return dist_q8 >> 8;
+}
+
+uint16_t odo_heading(void) {
+    return (uint16_t)(theta >> 16);
+}
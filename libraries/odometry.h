@@ -0,0 +1,58 @@
+/*
+
+Dead-reckoning odometry for the differential-drive cart
+
+Call odo_update() once per control tick with the encoder counts accumulated
+by each wheel since the previous call. Position and travelled distance are
+integrated from the wheel geometry; the heading comes from the difference
+between the wheels and is pulled towards the compass with a complementary
+filter whenever odo_compass() is given a reading.
+
+Angles are binary angles (see trig.h): 65536 = full turn, counter-clockwise
+positive, 0 = the direction the cart faced at odo_reset().
+
+Example C (100 ms control tick):
+odo_init();
+...
+if (flag) {
+    odo_update(counter1 - last1, counter2 - last2);
+    odo_compass(heading_brad);                       // optional
+}
+
+*/
+
+#ifndef ODOMETRY_H
+#define ODOMETRY_H
+
+#include <stdint.h>
+
+// Geometry
+#define ODO_WHEEL_DIAM_MM 42    // wheel diameter
+#define ODO_PULSES_PER_REV 48   // encoder counts per wheel revolution
+#ifndef ODO_TRACK_MM
+#define ODO_TRACK_MM 100        // distance between the wheels, measure on the cart
+#endif
+
+// Weight of the compass in the heading: each reading removes 1/2^N of the error
+#define ODO_COMPASS_SHIFT 4
+
+// Derived constants
+// mm per count in Q8, rounded: pi * D / N * 256
+#define ODO_MM_PER_PULSE_Q8 \
+    ((int32_t)((80425L * ODO_WHEEL_DIAM_MM + 50L * ODO_PULSES_PER_REV) / (100L * ODO_PULSES_PER_REV)))
+// heading change per count of wheel difference, 2^32 = full turn:
+// (pi * D / N) / T / (2 * pi) * 2^32 = D * 2^31 / (N * T)
+#define ODO_HEADING_GAIN \
+    ((((uint32_t)ODO_WHEEL_DIAM_MM << 25) / ((uint32_t)ODO_PULSES_PER_REV * ODO_TRACK_MM)) << 6)
+
+void odo_init(void);
+void odo_reset(int16_t x_mm, int16_t y_mm, uint16_t heading);
+void odo_update(int16_t left, int16_t right);
+void odo_compass(uint16_t heading);
+
+int16_t odo_x(void);               // mm
+int16_t odo_y(void);               // mm
+int32_t odo_distance(void);        // mm travelled by the cart's centre
+uint16_t odo_heading(void);        // brads
+
+#endif
@@ -0,0 +1,223 @@
+#include <xc.h>
+
+#include "always.h"
+#include "eedata.h"
+#include "params.h"
+#include "serial.h"
+
+static char line[PARAM_LINE];
+static uint8_t line_len;
+
+// Changes whenever a parameter is added, removed, retyped or re-ranged,
+// so values saved by another program are not loaded into the wrong slots
+static uint8_t signature(void) {
+    uint8_t sig = param_count;
+    uint8_t i;
+
+    for (i = 0; i < param_count; i++) {
+        sig = (uint8_t)((sig << 1) | (sig >> 7));
+        sig ^= (uint8_t)(param_defs[i].type + param_defs[i].min + param_defs[i].max);
+    }
+    return sig;
+}
+
+static uint8_t size(uint8_t id) {
+    return param_defs[id].type == PARAM_I16 ? 2 : 1;
+}
+
+void param_defaults(void) {
+    uint8_t i;
+
+    for (i = 0; i < param_count; i++) param_set(i, param_defs[i].def);
+}
+
+void param_init(void) {
+    line_len = 0;
+    if (!param_load()) param_defaults();
+}
+
+char param_set(uint8_t id, int16_t value) {
+    uint8_t gie = GIE;
+
+    if (id >= param_count || value < param_defs[id].min || value > param_defs[id].max) return FALSE;
+    gie_off;  // the ISR may read it, both bytes change together
+    param[id] = value;
+    if (gie) gie_on;
+    return TRUE;
+}
+
+// EEPROM: count, signature, values (low byte first), checksum
+char param_save(void) {
+    uint8_t addr = PARAM_EE_START + 2;
+    uint8_t sum = 0;
+    uint8_t i, v;
+
+    for (i = 0; i < param_count; i++) addr += size(i);
+    if (addr >= PARAM_EE_END) return FALSE;
+
+    addr = PARAM_EE_START;
+    eedata_write(addr++, param_count);
+    eedata_write(addr++, signature());
+    for (i = 0; i < param_count; i++) {
+        v = (uint8_t)param[i];
+        sum += v;
+        eedata_write(addr++, v);
+        if (size(i) == 2) {
+            v = (uint8_t)((uint16_t)param[i] >> 8);
+            sum += v;
+            eedata_write(addr++, v);
+        }
+    }
+    eedata_write(addr, sum ^ 0x5A);
+    return TRUE;
+}
+
+static char load(void) {
+    uint8_t addr = PARAM_EE_START + 2;
+    uint8_t sum = 0;
+    uint8_t i;
+    int16_t value;
+
+    if (EEPROM_READ(PARAM_EE_START) != param_count || EEPROM_READ(PARAM_EE_START + 1) != signature()) return FALSE;
+
+    // Check everything first, so a bad save leaves the current values alone
+    for (i = 0; i < param_count; i++) {
+        sum += EEPROM_READ(addr++);
+        if (size(i) == 2) sum += EEPROM_READ(addr++);
+    }
+    if (addr >= PARAM_EE_END || EEPROM_READ(addr) != (sum ^ 0x5A)) return FALSE;
+
+    addr = PARAM_EE_START + 2;
+    for (i = 0; i < param_count; i++) {
+        value = EEPROM_READ(addr++);
+        if (size(i) == 2) value = (int16_t)((uint16_t)value | (uint16_t)EEPROM_READ(addr++) << 8);
+        if (!param_set(i, value)) param_set(i, param_defs[i].def);  // range changed
+    }
+    return TRUE;
+}
+
+char param_load(void) {
+    uint8_t gie = eedata_claim();  // EEADR must not change under a write
+    char ok = load();
+
+    eedata_release(gie);
+    return ok;
+}
+
+static void put_number(int16_t n) {
+    char digits[6];
+    uint8_t i = 0;
+    uint16_t u;
+
+    if (n < 0) {
+        putch('-');
+        u = (uint16_t)(-(n + 1)) + 1;  // also right for -32768
+    } else {
+        u = (uint16_t)n;
+    }
+    do {
+        digits[i++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    while (i) putch(digits[--i]);
+}
+
+static void put_value(uint8_t id) {
+    put_number(id);
+    putch('=');
+    put_number(param[id]);
+    putch('\n');
+}
+
+static void list(void) {
+    static const char type_names[][5] = {"bool", "u8", "i16"};
+    const char *s;
+    uint8_t i;
+
+    for (i = 0; i < param_count; i++) {
+        put_number(i);
+        putch(' ');
+        for (s = param_defs[i].name; *s; s++) putch(*s);
+        putch(' ');
+        for (s = type_names[param_defs[i].type]; *s; s++) putch(*s);
+        putch(' ');
+        put_number(param_defs[i].min);
+        putch(' ');
+        put_number(param_defs[i].max);
+        putch(' ');
+        put_number(param_defs[i].def);
+        putch(' ');
+        put_number(param[i]);
+        putch('\n');
+    }
+}
+
+// Reads a decimal number from line[*pos], FALSE if there is none
+static char parse_number(uint8_t *pos, int16_t *value) {
+    char negative = FALSE;
+    uint8_t start;
+    int32_t n = 0;
+
+    if (*pos < line_len && line[*pos] == '-') {
+        negative = TRUE;
+        (*pos)++;
+    }
+    start = *pos;
+    while (*pos < line_len && line[*pos] >= '0' && line[*pos] <= '9') {
+        n = n * 10 + (line[*pos] - '0');
+        if (n > 32768) return FALSE;
+        (*pos)++;
+    }
+    if (*pos == start) return FALSE;
+    if (negative) n = -n;
+    if (n > 32767) return FALSE;
+    *value = (int16_t)n;
+    return TRUE;
+}
+
+static void execute(void) {
+    uint8_t pos = 0;
+    int16_t id, value;
+    char ok = FALSE;
+
+    if (line_len == 1 && line[0] == '?') {
+        list();
+        return;
+    }
+    if (line_len == 1 && (line[0] == 'S' || line[0] == 'L' || line[0] == 'Z')) {
+        if (line[0] == 'S') ok = param_save();
+        else if (line[0] == 'L') ok = param_load();
+        else {
+            param_defaults();
+            ok = TRUE;
+        }
+        putch(ok ? line[0] : 'E');
+        putch('\n');
+        return;
+    }
+
+    if (parse_number(&pos, &id) && id >= 0 && id < param_count) {
+        if (pos == line_len) ok = TRUE;  // read
+        else if (line[pos++] == '=' && parse_number(&pos, &value) && pos == line_len) ok = param_set((uint8_t)id, value);
+    }
+    if (ok) put_value((uint8_t)id);
+    else {
+        putch('E');
+        putch('\n');
+    }
+}
+
+uint8_t param_input(char c) {
+    if (c == '\r' || c == '\n') {
+        if (line_len && line_len <= PARAM_LINE) execute();
+        line_len = 0;
+        return 0;
+    }
+    if ((c >= '0' && c <= '9') || c == '=' || c == '-' || c == '?' || c == 'S' || c == 'L' || c == 'Z') {
+        if (line_len < PARAM_LINE) line[line_len++] = c;
+        else line_len = 0xFF;  // too long, dropped at the end of the line
+        return 0;
+    }
+    if ((uint8_t)c == 255) return 0;  // chkchr(): nothing received
+    return (uint8_t)c;
+}
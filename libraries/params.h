@@ -0,0 +1,95 @@
+/*
+
+Tunable parameters, changed over the serial channel and kept in EEPROM
+
+Each program declares its parameters once, with an X-macro list:
+ID, short name, type, minimum, maximum and default. PARAM_TABLE() turns the
+list into an enum of IDs, a const table in flash and the RAM array param[].
+A parameter is read as param[ID]; with a constant ID that is the same single
+load as reading a global variable.
+
+The serial protocol is one ASCII line per command, so a plain terminal is
+enough:
+
+    ?          list: "id name type min max default value" per parameter
+    3          read parameter 3            -> "3=550"
+    3=600      write parameter 3           -> "3=600", or "E" if out of range
+    S          save all parameters to EEPROM  -> "S"
+    L          load them back from EEPROM     -> "L", or "E" if none saved
+    Z          restore the defaults           -> "Z"
+
+Writes take effect at once, in RAM; S makes them survive a reset. At
+start-up param_init() loads the saved values, or the defaults if the EEPROM
+holds none or they were saved by a program with a different table.
+
+Bytes that are not part of the protocol are returned by param_input(), so a
+program can keep its own single-letter commands (the autonomous task's 'D').
+param_input() runs in the main loop; only "?" takes long enough (about 1 ms
+per character at 19200 bps) to be noticed, the others answer in a few
+characters.
+
+The parameters live in EEPROM bytes PARAM_EE_START..PARAM_EE_END (see
+eedata.h). Saving writes only the bytes that changed and waits for each one
+(about 4 ms), after the black box finished its own writes, so call
+param_init() before bbox_init() or after GIE = 1.
+
+Example C:
+// ID, name, type, min, max, default
+#define PARAMS(X)                                      \
+    X(P_DUTY_MAX, "dutymax", PARAM_I16, 0, 1023, 550)  \
+    X(P_TURN_PCT, "turn", PARAM_U8, 0, 100, 50)
+
+PARAM_TABLE(PARAMS);
+
+param_init();
+...
+c = param_input(chkchr());  // in the main loop
+pwm_set(1, param[P_DUTY_MAX]);
+
+*/
+
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include <stdint.h>
+
+#define PARAM_EE_START 0x00  // EEPROM bytes 0x00..0x3F, see eedata.h
+#define PARAM_EE_END 0x40
+#define PARAM_NAME 8         // characters of a name, with the terminating zero
+#define PARAM_LINE 12        // longest command line
+
+// Types: how many EEPROM bytes a value takes, and how it is listed
+#define PARAM_BOOL 0  // 0 or 1
+#define PARAM_U8 1    // 0..255
+#define PARAM_I16 2   // -32768..32767
+
+struct param_def {
+    char name[PARAM_NAME];
+    uint8_t type;
+    int16_t min;
+    int16_t max;
+    int16_t def;
+};
+
+#define PARAM_ID_(id, name, type, min, max, def) id,
+#define PARAM_DEF_(id, name, type, min, max, def) {name, type, min, max, def},
+
+#define PARAM_TABLE(list)                                       \
+    enum { list(PARAM_ID_) PARAM_COUNT };                       \
+    const struct param_def param_defs[] = {list(PARAM_DEF_)};   \
+    const uint8_t param_count = PARAM_COUNT;                    \
+    int16_t param[PARAM_COUNT]
+
+// Defined by PARAM_TABLE() in the program
+extern const struct param_def param_defs[];
+extern const uint8_t param_count;
+extern int16_t param[];
+
+void param_init(void);
+void param_defaults(void);
+char param_set(uint8_t id, int16_t value);  // FALSE if out of range
+char param_save(void);                       // FALSE if the table does not fit
+char param_load(void);                       // FALSE if nothing valid is saved
+uint8_t param_input(char c);                 // 0, or c if it is not a command byte
+
+#endif
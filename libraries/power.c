@@ -0,0 +1,154 @@
+#include <xc.h>
+
+#include "always.h"
+#include "bits.h"
+#include "power.h"
+#include "sensor.h"
+
+#define MS_TICKS(ms) ((uint16_t)(((ms) + POWER_TICK_MS - 1) / POWER_TICK_MS))
+#define WARMUP_TICKS MS_TICKS(POWER_WARMUP_MS)
+#define IDLE_TICKS ((uint16_t)POWER_IDLE_S * (1000 / POWER_TICK_MS))
+
+static uint16_t period;                // ticks between samples, 0 = supply off
+static volatile uint16_t countdown;    // ticks until the next sample
+static volatile uint8_t warm;          // ticks the supply has been on, saturating
+static volatile uint16_t beep_ticks;   // buzzer on while not 0
+static volatile uint16_t idle_ticks;   // ticks since power_activity()
+static volatile uint8_t led_mode;
+static volatile uint16_t led_phase;
+static char supply;                    // sensor_power() state, main loop only
+
+static void set_supply(char on) {
+    if (supply == on) return;
+    supply = on;
+    sensor_power(on ? ON : OFF);
+    warm = 0;
+}
+
+void power_init(void) {
+    period = 0;
+    countdown = 0;
+    beep_ticks = 0;
+    idle_ticks = 0;
+    led_mode = POWER_OFF;
+    supply = TRUE;  // unknown: force the first switch
+    set_supply(FALSE);
+    pin_clr(POWER_LED_PIN);
+    pin_clr(POWER_BUZZER_PIN);
+}
+
+void power_tick(void) {
+    if (countdown) countdown--;
+    if (warm < 255) warm++;
+    if (idle_ticks < IDLE_TICKS) idle_ticks++;
+
+    if (beep_ticks && --beep_ticks == 0) pin_clr(POWER_BUZZER_PIN);
+
+    if (led_mode == POWER_BLINK) {
+        if (++led_phase >= MS_TICKS(POWER_BLINK_MS)) led_phase = 0;
+        pin_write(POWER_LED_PIN, led_phase < MS_TICKS(POWER_FLASH_MS));
+    }
+}
+
+void power_sensors(uint16_t period_ms) {
+    uint8_t gie = GIE;
+    uint16_t ticks = MS_TICKS(period_ms);
+
+    if (ticks == period) return;
+    period = ticks;
+    gie_off;
+    countdown = ticks;
+    if (gie) gie_on;
+}
+
+char power_sensors_on(void) {
+    return supply && warm >= WARMUP_TICKS;
+}
+
+char power_sample(void) {
+    uint8_t gie;
+    char gated = period > WARMUP_TICKS + 1;
+    char due;
+
+    // The buzzer runs from the same supply
+    if (beep_ticks) {
+        set_supply(TRUE);
+    } else if (period == 0) {
+        set_supply(FALSE);
+        return FALSE;
+    } else if (!gated || countdown <= WARMUP_TICKS) {
+        set_supply(TRUE);  // always on, or warming up for the next sample
+    } else {
+        set_supply(FALSE);  // between samples
+    }
+
+    gie = GIE;
+    gie_off;
+    due = countdown == 0;
+    if (due && warm >= WARMUP_TICKS) {
+        countdown = period;
+    } else {
+        due = FALSE;  // not yet, or waiting for the warm-up after a late power-up
+    }
+    if (gie) gie_on;
+    return due;
+}
+
+void power_beep(uint16_t ms) {
+    uint8_t gie = GIE;
+
+    set_supply(TRUE);
+    gie_off;
+    beep_ticks = MS_TICKS(ms);
+    if (gie) gie_on;
+    pin_set(POWER_BUZZER_PIN);
+}
+
+void power_led(uint8_t mode) {
+    if (mode == led_mode) return;
+    led_mode = mode;
+    led_phase = 0;
+    pin_write(POWER_LED_PIN, mode != POWER_OFF);
+}
+
+void power_activity(void) {
+    uint8_t gie = GIE;
+
+    gie_off;
+    idle_ticks = 0;
+    if (gie) gie_on;
+}
+
+char power_sleepy(void) {
+    uint8_t gie = GIE;
+    char sleepy;
+
+    gie_off;
+    sleepy = idle_ticks >= IDLE_TICKS;
+    if (gie) gie_on;
+    return sleepy;
+}
+
+void power_sleep(void) {
+    uint8_t mode = led_mode;
+    uint8_t rbie = RBIE;
+
+    beep_ticks = 0;
+    pin_clr(POWER_BUZZER_PIN);
+    led_mode = POWER_OFF;
+    pin_clr(POWER_LED_PIN);
+    set_supply(FALSE);
+
+    (void)PORTB;  // end an old mismatch, so only a new change wakes
+    RBIF = 0;
+    RBIE = 1;     // the key wakes the PIC through Port B interrupt-on-change
+    while (1) {
+        SLEEP();
+        NOP();
+        if (STATUSbits.nTO) break;  // not the watchdog: the key
+    }
+
+    RBIE = rbie;  // off again if the key is sampled by the tick (input.h)
+    power_activity();
+    power_led(mode);
+}
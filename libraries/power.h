@@ -0,0 +1,78 @@
+/*
+
+Power management: sensor supply gating, LED and buzzer timing, sleep when idle
+
+The IR emitters of the line and proximity sensors share one supply
+(sensor_power()) and draw far more than the PIC. This module keeps the
+supply on only around the samples: power_sensors(period) asks for a sample
+every period ms, and the supply is switched on POWER_WARMUP_MS before each
+one, the time the proximity sensor needs after power-up (see
+"1 - sensor read"). When the period is not much longer than the warm-up
+(the autonomous task samples every 40 ms), the supply simply stays on.
+
+    if (power_sample()) {            // main loop: switches the supply,
+        value = sensorNear_read();   // TRUE when a warm sample is due
+    }
+
+The buzzer needs the sensor supply as well; power_beep() keeps it on for the
+beep and turns both off afterwards, without the blocking delay. The status
+LED is on, off, or blinks with short flashes (POWER_FLASH_MS every
+POWER_BLINK_MS) instead of a 50 % square wave. Both are timed by
+power_tick() from the Timer 0 interrupt.
+
+The PIC16F886 has no idle mode, and its PWM, Timer 0 and USART stop in
+sleep, so the CPU can only sleep while nothing runs: power_sleepy() is
+TRUE after POWER_IDLE_S without power_activity() (key, serial command), and
+power_sleep() then turns everything off and sleeps until the key changes
+Port B. Watchdog time-outs during sleep go straight back to sleep.
+Characters arriving on the serial channel do not wake the PIC.
+
+tools/energy_model.py estimates the charge this saves per run.
+
+Example C:
+// Timer 0 interrupt, every 5 ms
+power_tick();
+
+// main loop
+power_sensors(250);                  // a proximity sample every 250 ms
+if (power_sample()) sum += sensorNear_read();
+power_led(POWER_BLINK);
+if (key_pressed()) power_activity();
+if (power_sleepy()) power_sleep();
+
+*/
+
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+#define POWER_TICK_MS 5      // power_tick() period
+#define POWER_WARMUP_MS 40   // proximity sensor start-up after sensor_power(ON)
+#define POWER_FLASH_MS 20    // LED flash length when blinking
+#define POWER_BLINK_MS 500   // LED flash period
+#define POWER_IDLE_S 60      // inactivity before power_sleepy()
+
+#define POWER_LED_PIN PORTB, 5     // bits.h descriptors
+#define POWER_BUZZER_PIN PORTB, 7
+
+// Status LED modes
+#define POWER_OFF 0
+#define POWER_ON 1
+#define POWER_BLINK 2
+
+void power_init(void);
+void power_tick(void);  // Timer 0 interrupt
+
+void power_sensors(uint16_t period_ms);  // 0 = supply off
+char power_sample(void);                  // main loop: TRUE when a sample is due
+char power_sensors_on(void);              // supply on and warmed up
+
+void power_beep(uint16_t ms);
+void power_led(uint8_t mode);
+
+void power_activity(void);
+char power_sleepy(void);
+void power_sleep(void);
+
+#endif
@@ -0,0 +1,122 @@
+#include "profile.h"
+
+// Per-tick limits in Q8
+static int32_t acc_step;   // speed change per tick when speeding up
+static int32_t dec_step;   // speed change per tick when slowing down
+static int32_t jerk_step;  // acceleration change per tick, 0 = unlimited
+
+struct wheel {
+    int32_t speed;  // Q8
+    int32_t accel;  // Q8 speed change per tick
+    int16_t target;
+};
+
+static struct wheel wheels[PROFILE_CHANNELS];
+
+static char within(int32_t v, int32_t bound) {
+    return v <= bound && v >= -bound;
+}
+
+static void wheel_step(struct wheel *w) {
+    int32_t target = (int32_t)w->target * 256;
+    int32_t dv = target - w->speed;
+    int32_t limit, goal, ramp;
+
+    if (dv == 0 && w->accel == 0) return;
+
+    // Slowing down means moving towards 0 from either side
+    limit = ((w->speed >= 0) == (dv >= 0)) ? acc_step : dec_step;
+
+    if (jerk_step == 0) {
+        goal = dv > limit ? limit : (dv < -limit ? -limit : dv);
+        w->accel = goal;
+    } else if (within(dv, limit) && within(dv, jerk_step) && within(dv - w->accel, jerk_step)) {
+        // Lands on the target this tick, the acceleration changing by at most
+        // a jerk step on the way in and out; ramping instead would swing
+        // around a target closer than one step for ever
+        w->speed = target;
+        w->accel = 0;
+        return;
+    } else {
+        // Speed still gained if the acceleration were ramped to 0 from now on
+        ramp = w->accel * (w->accel < 0 ? -w->accel : w->accel) / (2 * jerk_step) + w->accel / 2;
+        goal = dv > ramp ? limit : (dv < ramp ? -limit : 0);
+
+        if (w->accel < goal) {
+            w->accel += jerk_step;
+            if (w->accel > goal) w->accel = goal;
+        } else if (w->accel > goal) {
+            w->accel -= jerk_step;
+            if (w->accel < goal) w->accel = goal;
+        }
+    }
+
+    w->speed += w->accel;
+
+    // Never overshoot the target: a step that reaches or crosses it, or
+    // starts on it with the acceleration still ramping down, ends on it
+    if ((dv >= 0 && w->speed >= target) || (dv <= 0 && w->speed <= target)) {
+        w->speed = target;
+        if (jerk_step == 0 || (w->accel <= jerk_step && w->accel >= -jerk_step)) w->accel = 0;
+    }
+}
+
+void profile_init(void) {
+    uint8_t i;
+
+    for (i = 0; i < PROFILE_CHANNELS; i++) {
+        wheels[i].speed = 0;
+        wheels[i].accel = 0;
+        wheels[i].target = 0;
+    }
+    profile_limits(1500, 2500, 0);
+}
+
+void profile_limits(int16_t accel, int16_t decel, int16_t jerk) {
+    acc_step = (int32_t)accel * 256 * PROFILE_DT_MS / 1000;
+    dec_step = (int32_t)decel * 256 * PROFILE_DT_MS / 1000;
+    jerk_step = (int32_t)jerk * 256 / 1000 * PROFILE_DT_MS * PROFILE_DT_MS / 1000;
+    if (jerk && jerk_step == 0) jerk_step = 1;
+}
+
+void profile_set(char channel, int16_t target) {
+    wheels[channel - 1].target = target;
+}
+
+void profile_force(char channel, int16_t speed) {
+    struct wheel *w = &wheels[channel - 1];
+
+    w->target = speed;
+    w->speed = (int32_t)speed * 256;
+    w->accel = 0;
+}
+
+void profile_step(void) {
+    uint8_t i;
+
+    for (i = 0; i < PROFILE_CHANNELS; i++) {
+        wheel_step(&wheels[i]);
+    }
+}
+
+int16_t profile_get(char channel) {
+    return (int16_t)(wheels[channel - 1].speed / 256);
+}
+
+int16_t profile_target(char channel) {
+    return wheels[channel - 1].target;
+}
+
+int32_t profile_stop_distance(char channel) {
+    // Run the same integrator on a copy, so the prediction is exact
+    struct wheel w = wheels[channel - 1];
+    int32_t sum = 0;
+    uint16_t n;
+
+    w.target = 0;
+    for (n = 0; n < 1000 && (w.speed != 0 || w.accel != 0); n++) {
+        wheel_step(&w);
+        sum += w.speed;
+    }
+    return sum / 256 * PROFILE_DT_MS / 1000;
+}
@@ -0,0 +1,49 @@
+/*
+
+Acceleration- and jerk-limited motion profiles for the two wheels
+
+Turns the speed a program asks for into a smooth setpoint stream, one step
+per control tick. Channels are numbered like pwm_set(): 1 = right motor,
+2 = left motor, the one the line follower slows to turn left (follow.h).
+Speeds may be in any unit (duty cycle, mm/s); limits are in the same unit
+per second (acceleration) and per second squared (jerk). Speeding up is
+limited by the acceleration limit, slowing down (towards 0, in either
+direction) by the deceleration limit. A jerk limit of 0 gives a trapezoidal
+profile, otherwise the acceleration itself ramps (S-curve).
+
+Everything is integer: setpoints are kept in Q8 and the limits are turned
+into per-tick increments once, in profile_limits().
+
+Example C:
+profile_init();
+profile_limits(1500, 2500, 15000);   // duty/s, duty/s, duty/s^2
+...
+profile_set(1, duty_cycle);          // any time
+profile_set(2, 5 * duty_cycle / 10);
+if (control_tick) {                  // every PROFILE_DT_MS
+    profile_step();
+    pwm_set(1, profile_get(1));
+    pwm_set(2, profile_get(2));
+}
+
+*/
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+#define PROFILE_DT_MS 40    // profile_step() period
+#define PROFILE_CHANNELS 2
+
+void profile_init(void);
+void profile_limits(int16_t accel, int16_t decel, int16_t jerk);
+void profile_set(char channel, int16_t target);
+void profile_force(char channel, int16_t speed);  // jump without a ramp
+void profile_step(void);
+
+int16_t profile_get(char channel);
+int16_t profile_target(char channel);
+int32_t profile_stop_distance(char channel);  // speed unit * s, if the target became 0 now
+
+#endif
@@ -0,0 +1,36 @@
+#include "trig.h"
+
+// sin(i * 90 / 64 degrees) in Q14, i = 0..64
+static const int16_t sine_table[65] = {
+    0, 402, 804, 1205, 1606, 2006, 2404, 2801,
+    3196, 3590, 3981, 4370, 4756, 5139, 5520, 5897,
+    6270, 6639, 7005, 7366, 7723, 8076, 8423, 8765,
+    9102, 9434, 9760, 10080, 10394, 10702, 11003, 11297,
+    11585, 11866, 12140, 12406, 12665, 12916, 13160, 13395,
+    13623, 13842, 14053, 14256, 14449, 14635, 14811, 14978,
+    15137, 15286, 15426, 15557, 15679, 15791, 15893, 15986,
+    16069, 16143, 16207, 16261, 16305, 16340, 16364, 16379,
+    16384,
+};
+
+int16_t isin(uint16_t angle) {
+    uint8_t quadrant = angle >> 14;          // 0..3
+    uint8_t index = (angle >> 8) & 0x3F;     // position inside the quadrant
+    uint8_t frac = angle & 0xFF;             // interpolation between entries
+    int16_t a, b, value;
+
+    if (quadrant & 1) {  // 2nd and 4th quadrants run the table backwards
+        a = sine_table[64 - index];
+        b = sine_table[63 - index];
+    } else {
+        a = sine_table[index];
+        b = sine_table[index + 1];
+    }
+    value = a + (int16_t)(((int32_t)(b - a) * frac) >> 8);
+
+    return (quadrant & 2) ? -value : value;
+}
+
+int16_t icos(uint16_t angle) {
+    return isin(angle + 16384u);
+}
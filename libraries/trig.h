@@ -0,0 +1,29 @@
+/*
+
+Fixed-point sine and cosine
+
+Angles are binary angles ("brads"): a uint16_t where 65536 is a full turn,
+so 16384 = 90 degrees and wrap-around is free. Results are Q14, i.e.
+16384 = 1.0.
+
+The quarter-wave table has 65 entries (256 steps per turn) and lives in
+flash; the low 8 bits of the angle interpolate linearly between entries,
+which keeps the error below 0.02%.
+
+Example C:
+int16_t s = isin(BRAD_DEG(30));  // s ~ 8192 (0.5)
+
+*/
+
+#ifndef TRIG_H
+#define TRIG_H
+
+#include <stdint.h>
+
+#define TRIG_ONE 16384                            // 1.0 in Q14
+#define BRAD_DEG(deg) ((uint16_t)((deg) * 65536L / 360))
+
+int16_t isin(uint16_t angle);
+int16_t icos(uint16_t angle);
+
+#endif
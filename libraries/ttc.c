@@ -0,0 +1,114 @@
+#include "ttc.h"
+
+static char tracking;   // obstacle in range
+static int32_t dist16;  // filtered distance, mm * 16
+static int32_t vel16;   // obstacle velocity, mm/s * 16, > 0 moving away
+static int16_t speed;   // own speed of the last update, mm/s
+static int16_t clearance = TTC_CLEARANCE_MM;
+static int16_t full_speed = TTC_MMPS_FULL;
+
+static uint16_t isqrt32(uint32_t x) {
+    uint32_t root = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > x) bit >>= 2;
+    while (bit) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint16_t)root;
+}
+
+void ttc_init(void) {
+    tracking = 0;
+    dist16 = 0;
+    vel16 = 0;
+    speed = 0;
+}
+
+void ttc_clearance(int16_t mm) {
+    clearance = mm;
+}
+
+void ttc_full_speed(int16_t mmps) {
+    full_speed = mmps > 0 ? mmps : TTC_MMPS_FULL;
+}
+
+void ttc_update(int16_t adc, int16_t speed_mmps) {
+    int16_t meas = TTC_NONE;
+    int32_t residual;
+
+    if (adc >= 0) {
+        meas = (int16_t)(TTC_CAL_M / (adc + TTC_CAL_B) - TTC_CAL_K);
+    }
+    speed = speed_mmps;
+
+    if (meas > TTC_RANGE_MM) {  // nothing in front of the cart
+        tracking = 0;
+        return;
+    }
+
+    if (!tracking) {  // first reading: assume a static obstacle
+        tracking = 1;
+        dist16 = (int32_t)meas * 16;
+        vel16 = 0;
+        return;
+    }
+
+    // Predict with the obstacle velocity and our own speed
+    dist16 += (vel16 - (int32_t)speed * 16) * TTC_DT_MS / 1000;
+
+    // Correct
+    residual = (int32_t)meas * 16 - dist16;
+    dist16 += residual / (1 << TTC_ALPHA_SHIFT);
+    vel16 += residual * 1000 / TTC_DT_MS / (1 << TTC_BETA_SHIFT);
+}
+
+int16_t ttc_distance(void) {
+    return tracking ? (int16_t)(dist16 / 16) : TTC_NONE;
+}
+
+int16_t ttc_closing(void) {
+    return tracking ? (int16_t)(speed - vel16 / 16) : 0;
+}
+
+int16_t ttc_time(void) {
+    int16_t closing = ttc_closing();
+    int32_t gap;
+
+    if (!tracking || closing <= 0) return TTC_NONE;
+
+    gap = dist16 / 16 - clearance;
+    if (gap <= 0) return 0;
+    gap = gap * 1000 / closing;
+    return gap > TTC_NONE ? TTC_NONE : (int16_t)gap;
+}
+
+int16_t ttc_speed_limit(void) {
+    int32_t gap, limit;
+
+    if (!tracking) return TTC_NONE;
+
+    // Distance left after the reaction time of one update period
+    gap = dist16 / 16 - clearance - (int32_t)ttc_closing() * TTC_DT_MS / 1000;
+    if (gap <= 0) return 0;
+
+    limit = vel16 / 16 + isqrt32(2UL * TTC_DECEL_MMPS2 * (uint32_t)gap);
+    if (limit <= 0) return 0;
+    return limit > TTC_NONE ? TTC_NONE : (int16_t)limit;
+}
+
+int ttc_duty_limit(int duty) {
+    int16_t limit = ttc_speed_limit();
+    int32_t max_duty;
+
+    if (limit == TTC_NONE) return duty;
+
+    max_duty = (int32_t)limit * TTC_DUTY_FULL / full_speed;
+    return max_duty < duty ? (int)max_duty : duty;
+}
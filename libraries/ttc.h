@@ -0,0 +1,64 @@
+/*
+
+Time-to-collision estimator and braking schedule
+
+An alpha-beta filter tracks the distance to the obstacle seen by the GP2D120
+proximity sensor and the obstacle's own velocity. The cart's speed from the
+encoders is fed in separately, so a static obstacle is predicted correctly
+even between noisy readings, and closing velocity = own speed - obstacle
+velocity.
+
+From the filtered state the module gives the time left before reaching the
+stopping clearance, and the highest speed from which a constant deceleration
+of TTC_DECEL_MMPS2 still stops the cart at TTC_CLEARANCE_MM:
+
+    v_allowed = v_obstacle + sqrt(2 * a * (d - clearance))
+
+Call ttc_update() every TTC_DT_MS (the sensor refreshes every ~38 ms). The
+clearance is TTC_CLEARANCE_MM until ttc_clearance() sets another one, and
+ttc_duty_limit() takes TTC_DUTY_FULL to be TTC_MMPS_FULL until
+ttc_full_speed() gives the cart's measured top speed (ffwd.h).
+
+Example C:
+if (control_tick) {
+    ttc_update(sensorNear_read(), speed_mmps);  // 0 if the speed is unknown
+}
+duty_cycle = ttc_duty_limit(duty_max);
+
+*/
+
+#ifndef TTC_H
+#define TTC_H
+
+#include <stdint.h>
+
+#define TTC_DT_MS 40            // update period
+#define TTC_CLEARANCE_MM 60     // stop this far from the obstacle, by default
+#define TTC_DECEL_MMPS2 1500    // deceleration the cart achieves when braking
+#define TTC_RANGE_MM 300        // readings farther than this mean "no obstacle"
+#define TTC_MMPS_FULL 800       // cart speed at 100% duty, without a measured one
+#define TTC_DUTY_FULL 1023
+
+// Filter gains as shifts: alpha = 1/2^A, beta = 1/2^B
+#define TTC_ALPHA_SHIFT 1
+#define TTC_BETA_SHIFT 3
+
+// Sensor calibration from activity 1: R = 23256 / (V + 14) - 2
+#define TTC_CAL_M 23256L
+#define TTC_CAL_B 14
+#define TTC_CAL_K 2
+
+#define TTC_NONE 0x7FFF  // no obstacle / no collision predicted
+
+void ttc_init(void);
+void ttc_clearance(int16_t mm);  // kept by ttc_init()
+void ttc_full_speed(int16_t mmps);  // at TTC_DUTY_FULL, kept by ttc_init(); <= 0: TTC_MMPS_FULL
+void ttc_update(int16_t adc, int16_t speed_mmps);
+
+int16_t ttc_distance(void);     // filtered distance in mm, TTC_NONE if clear
+int16_t ttc_closing(void);      // closing velocity in mm/s, > 0 when approaching
+int16_t ttc_time(void);         // ms until the clearance is reached, TTC_NONE if not closing
+int16_t ttc_speed_limit(void);  // highest own speed that still stops in time, mm/s
+int ttc_duty_limit(int duty);   // duty clamped to ttc_speed_limit()
+
+#endif
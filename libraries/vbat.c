@@ -0,0 +1,66 @@
+#include "vbat.h"
+
+// VBAT_NOMINAL_MV / V in Q8 for V = 5.8 V .. 8.4 V, derated below VBAT_LOW_MV
+static const uint16_t factor_table[VBAT_TABLE_SIZE] = {
+    159, 205, 248, 288, 279, 271, 263, 256, 249, 243, 236, 230, 225, 219,
+};
+
+static int32_t filtered;  // mV * 2^VBAT_FILTER_SHIFT
+static uint16_t factor;
+static uint8_t ticks;
+
+void vbat_init(void) {
+    filtered = 0;
+    factor = 256;
+    ticks = VBAT_PERIOD_TICKS - 1;  // read on the first tick
+}
+
+char vbat_tick(void) {
+    if (++ticks < VBAT_PERIOD_TICKS) return 0;
+    ticks = 0;
+    return 1;
+}
+
+void vbat_update(int16_t millivolts) {
+    int16_t mv, offset;
+    uint8_t index, frac;
+
+    if (filtered == 0) {
+        filtered = (int32_t)millivolts << VBAT_FILTER_SHIFT;
+    } else {
+        filtered += millivolts - (filtered >> VBAT_FILTER_SHIFT);
+    }
+
+    mv = vbat_millivolts();
+    offset = mv - VBAT_TABLE_MIN_MV;
+    if (offset <= 0) {
+        factor = factor_table[0];
+    } else if (offset >= (VBAT_TABLE_SIZE - 1) * VBAT_TABLE_STEP_MV) {
+        factor = factor_table[VBAT_TABLE_SIZE - 1];
+    } else {
+        index = (uint8_t)(offset / VBAT_TABLE_STEP_MV);
+        frac = (uint8_t)((offset % VBAT_TABLE_STEP_MV) * 256L / VBAT_TABLE_STEP_MV);
+        factor = factor_table[index] +
+                 (int16_t)(((int16_t)factor_table[index + 1] - factor_table[index]) * frac / 256);
+    }
+}
+
+int16_t vbat_millivolts(void) {
+    return (int16_t)(filtered >> VBAT_FILTER_SHIFT);
+}
+
+uint16_t vbat_factor(void) {
+    return factor;
+}
+
+char vbat_low(void) {
+    return filtered != 0 && vbat_millivolts() < VBAT_LOW_MV;
+}
+
+int vbat_scale(int duty) {
+    int32_t scaled = ((int32_t)duty * factor) >> 8;
+
+    if (scaled > VBAT_DUTY_MAX) return VBAT_DUTY_MAX;
+    if (scaled < -VBAT_DUTY_MAX) return -VBAT_DUTY_MAX;
+    return (int)scaled;
+}
@@ -0,0 +1,53 @@
+/*
+
+Battery-voltage compensation of the motor duty cycle
+
+The same duty cycle gives a faster cart on a fresh pack than on a tired one.
+This module filters the battery voltage and scales every duty cycle by
+VBAT_NOMINAL_MV / V_battery, so the average voltage across the motors, and
+therefore the speed, stays the same while the pack discharges. Below
+VBAT_LOW_MV the factor is derated, down to half at VBAT_CUTOFF_MV, to spare
+the pack and signal that it needs charging.
+
+The factor comes from a 14-entry Q8 table (5.8 V to 8.4 V in 200 mV steps)
+with linear interpolation. Only vbat_update(), once a second, divides;
+vbat_scale() on every duty cycle is a multiply and a shift.
+
+Reading the battery goes through SPI, which the LCD also uses, so it must be
+done from the main loop, not from the ISR. Call vbat_tick() every control
+tick; it returns TRUE when a new reading is due, about once a second.
+
+Example C:
+if (vbat_tick()) {
+    vbat_update(battery_read());     // millivolts
+}
+pwm_set(1, vbat_scale(duty_cycle));
+
+*/
+
+#ifndef VBAT_H
+#define VBAT_H
+
+#include <stdint.h>
+
+#define VBAT_NOMINAL_MV 7200  // voltage the motor tuning was done at
+#define VBAT_LOW_MV 6400      // below this, derate
+#define VBAT_CUTOFF_MV 5800   // half power here and below
+#define VBAT_TABLE_MIN_MV 5800
+#define VBAT_TABLE_STEP_MV 200
+#define VBAT_TABLE_SIZE 14
+
+#define VBAT_PERIOD_TICKS 25  // control ticks between readings
+#define VBAT_FILTER_SHIFT 2   // each reading moves the filter 1/4 of the way
+#define VBAT_DUTY_MAX 1023    // PWM full scale
+
+void vbat_init(void);
+char vbat_tick(void);
+void vbat_update(int16_t millivolts);
+
+int16_t vbat_millivolts(void);  // filtered voltage, 0 before the first reading
+uint16_t vbat_factor(void);      // Q8 duty scale, 256 = no change
+char vbat_low(void);             // TRUE below VBAT_LOW_MV
+int vbat_scale(int duty);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+
+Host model of the proximity reading with the motors running (libraries/adcsync.h)
+
+Every PWM edge rings on the GP2D120's signal: a damped oscillation that
+starts at the edge, with a random amplitude and phase. Both motor outputs
+rise together when the Timer 2 period starts and each falls at its own
+duty cycle; the ringing of the edges of the period before is carried over.
+On top of that the sensor has its own white noise. A reading is the signal
+at the moment the conversion starts, quantized to 10 bits.
+
+Two ways of reading are compared, for several pairs of duty cycles:
+
+    free     sensorNear_read(), started at any point of the period
+    synced   adcsync_read(), started ADCSYNC_BEFORE counts before the
+             period ends, plus the jitter of the polling loop
+
+and for each the model reports:
+
+    mean, sd     of the readings, counts
+    worst        largest error, counts
+    over         % of the readings at or above the stop threshold while
+                 the signal is below it (false stops)
+
+The ringing's amplitude, decay and frequency are estimates, to be replaced
+by what a scope shows on the sensor's output with the motors running; the
+bench command 'N' of "3 - dc motor" measures the same spread on the cart.
+
+Build and run from the repository root:
+    cc -O2 -I libraries tools/adcnoise.c -lm -o adcnoise
+    ./adcnoise
+    ./adcnoise --signal 480 --ring 80 -n 200000
+
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adcsync.h"
+
+// PWM, as in "3 - dc motor/main.c": PR2 = 255, Timer 2 at Fosc/4 = 5 MHz
+#define PERIOD 256      // Timer 2 counts
+#define COUNT_US 0.2
+
+// Noise model, estimates
+#define RING_TAU_US 1.0    // decay of the ringing
+#define RING_MHZ 1.5       // its frequency
+#define WHITE 2.0          // sensor noise, counts (1 sigma)
+#define POLL_JITTER 6      // Timer 2 counts, the polling loop of adcsync_read()
+#define THRESHOLD 500      // stop threshold of "3 - dc motor" and "4 - autonomous task"
+
+struct edge {
+    double at;    // Timer 2 counts from the start of this period, < 0 = the period before
+    double amp;   // counts
+    double phase;
+};
+
+struct result {
+    double sum, sum2, worst;
+    long n, over;
+};
+
+static double ring = 60;  // amplitude of one edge, counts
+
+static double uniform(void) {
+    return rand() / (RAND_MAX + 1.0);
+}
+
+static double gauss(void) {
+    double u = uniform() + 1e-12, v = uniform();
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+// Edges of this period and the one before, duties in 0..1023 like pwm_set()
+static int edges(struct edge *e, int duty1, int duty2) {
+    int n = 0, k, p;
+    int duty[2] = {duty1, duty2};
+
+    for (p = -1; p <= 0; p++) {
+        for (k = 0; k < 2; k++) {
+            if (duty[k] <= 0 || duty[k] >= 1023) continue;  // no switching
+            e[n].at = p * PERIOD;  // rises
+            e[n].amp = ring * (0.5 + uniform());
+            e[n++].phase = 2 * M_PI * uniform();
+            e[n].at = p * PERIOD + duty[k] / 4.0;  // falls
+            e[n].amp = -ring * (0.5 + uniform());
+            e[n++].phase = 2 * M_PI * uniform();
+        }
+    }
+    return n;
+}
+
+static int reading(double signal, double t, const struct edge *e, int n) {
+    double v = signal + gauss() * WHITE, dt;
+    int k;
+
+    for (k = 0; k < n; k++) {
+        dt = (t - e[k].at) * COUNT_US;
+        if (dt < 0) continue;
+        v += e[k].amp * exp(-dt / RING_TAU_US) * cos(2 * M_PI * RING_MHZ * dt + e[k].phase);
+    }
+    v = floor(v + 0.5);
+    return v < 0 ? 0 : v > 1023 ? 1023 : (int)v;
+}
+
+static void add(struct result *r, int value, double signal) {
+    double err = fabs(value - signal);
+
+    r->sum += value;
+    r->sum2 += (double)value * value;
+    r->n++;
+    if (err > r->worst) r->worst = err;
+    if (signal < THRESHOLD && value >= THRESHOLD) r->over++;
+}
+
+static void print_result(const char *name, const struct result *r) {
+    double mean = r->sum / r->n;
+
+    printf("  %-7s %7.1f %6.2f %6.0f %7.3f", name, mean, sqrt(r->sum2 / r->n - mean * mean), r->worst,
+           100.0 * r->over / r->n);
+}
+
+int main(int argc, char **argv) {
+    static const int duties[][2] = {{0, 0}, {205, 205}, {512, 512}, {820, 820}, {512, 820}, {970, 970}};
+    double signal = 470;
+    long samples = 100000, i;
+    int before = ADCSYNC_BEFORE, n, k;
+    struct edge e[8];
+
+    for (k = 1; k < argc; k++) {
+        if (!strcmp(argv[k], "-n") && k + 1 < argc) samples = atol(argv[++k]);
+        else if (!strcmp(argv[k], "-s") && k + 1 < argc) srand((unsigned)atoi(argv[++k]));
+        else if (!strcmp(argv[k], "--signal") && k + 1 < argc) signal = atof(argv[++k]);
+        else if (!strcmp(argv[k], "--ring") && k + 1 < argc) ring = atof(argv[++k]);
+        else if (!strcmp(argv[k], "--before") && k + 1 < argc) before = atoi(argv[++k]);
+        else {
+            fprintf(stderr, "usage: %s [-n samples] [-s seed] [--signal counts] [--ring counts] [--before counts]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (samples < 1 || before < 0 || before + POLL_JITTER > PERIOD) {
+        fprintf(stderr, "-n must be positive, --before inside the period\n");
+        return 1;
+    }
+
+    printf("signal %.0f counts, ringing %.0f counts, sample %d counts before the period ends\n\n", signal, ring,
+           before);
+    printf("%5s %5s  %-7s %7s %6s %6s %7s  %-7s %7s %6s %6s %7s\n", "duty1", "duty2", "", "mean", "sd", "worst",
+           "over%", "", "mean", "sd", "worst", "over%");
+    for (k = 0; k < (int)(sizeof duties / sizeof duties[0]); k++) {
+        struct result free_run, synced;
+
+        memset(&free_run, 0, sizeof free_run);
+        memset(&synced, 0, sizeof synced);
+        for (i = 0; i < samples; i++) {
+            n = edges(e, duties[k][0], duties[k][1]);
+            add(&free_run, reading(signal, uniform() * PERIOD, e, n), signal);
+            n = edges(e, duties[k][0], duties[k][1]);
+            add(&synced, reading(signal, PERIOD - before + uniform() * POLL_JITTER, e, n), signal);
+        }
+        printf("%5d %5d", duties[k][0], duties[k][1]);
+        print_result("free", &free_run);
+        print_result("synced", &synced);
+        printf("\n");
+    }
+    return 0;
+}
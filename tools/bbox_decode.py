@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""Decode a black-box dump (libraries/blackbox.h) from the cart.
+
+The dump is "BB", a record count and 8-byte records, oldest first. Read it
+from a file captured with the bootloader terminal, or directly from the
+serial port (needs pyserial), which sends the 'D' request itself:
+
+    tools/bbox_decode.py capture.bin
+    tools/bbox_decode.py --port /dev/ttyUSB0
+    tools/bbox_decode.py --csv capture.bin > run.csv
+"""
+
+import argparse
+import sys
+
+RECORD = 8
+TICK_MS = 40  # CONTROL_DT_MS of the autonomous task
+
+TYPES = {
+    0x10: "reset",
+    0x20: "start",
+    0x30: "stop",
+    0x40: "summary",
+    0x50: "obstacle",
+    0x60: "line-lost",
+}
+
+
+def reset_cause(data):
+    causes = [name for bit, name in ((1, "power-on"), (2, "brown-out"), (4, "watchdog")) if data & bit]
+    return "+".join(causes) or "mclr"
+
+
+def detail(kind, data):
+    if kind == 0x10:
+        return reset_cause(data)
+    if kind == 0x30:
+        return "events waiting at most %d, dropped %d%s" % (data >> 4, data & 15, "+" if (data & 15) == 15 else "")
+    if kind == 0x40:
+        return "battery %.2f V" % (data * 0.05)
+    if kind == 0x60:
+        return "line %s" % format(data & 7, "03b")
+    return ""
+
+
+def checksum(record):
+    return (sum(record[:7]) & 0xFF) ^ 0x5A
+
+
+def decode(data):
+    start = data.find(b"BB")
+    if start < 0 or start + 3 > len(data):
+        raise ValueError("no black-box dump found")
+    count = data[start + 2]
+    body = data[start + 3:start + 3 + count * RECORD]
+    if len(body) < count * RECORD:
+        raise ValueError("dump truncated: %d of %d records" % (len(body) // RECORD, count))
+    for i in range(count):
+        r = body[i * RECORD:(i + 1) * RECORD]
+        kind = r[1] & 0xF0
+        yield {
+            "seq": r[0],
+            "type": TYPES.get(kind, "0x%02x" % kind),
+            "state": r[1] & 0x0F,
+            "time_s": (r[2] | r[3] << 8) * TICK_MS / 1000.0,
+            "closest": r[4] << 2,
+            "lap": r[5],
+            "detail": detail(kind, r[6]),
+            "ok": r[7] == checksum(r),
+        }
+
+
+def read_port(port, baud):
+    import serial  # pyserial
+
+    with serial.Serial(port, baud, timeout=2) as link:
+        link.reset_input_buffer()
+        link.write(b"D")
+        head = link.read(3)
+        if len(head) < 3:
+            raise ValueError("no answer from the cart")
+        return head + link.read(head[2] * RECORD)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("file", nargs="?", help="captured dump")
+    parser.add_argument("--port", help="read from this serial port instead")
+    parser.add_argument("--baud", type=int, default=19200)
+    parser.add_argument("--csv", action="store_true", help="CSV instead of a table")
+    args = parser.parse_args()
+
+    if args.port:
+        data = read_port(args.port, args.baud)
+    elif args.file:
+        with open(args.file, "rb") as f:
+            data = f.read()
+    else:
+        data = sys.stdin.buffer.read()
+
+    records = list(decode(data))
+    if args.csv:
+        print("seq,type,state,time_s,closest,lap,detail,ok")
+        for r in records:
+            print("%(seq)d,%(type)s,%(state)d,%(time_s).2f,%(closest)d,%(lap)d,%(detail)s,%(ok)d" % r)
+    else:
+        print("%4s  %-10s %5s %9s %8s %4s  %s" % ("seq", "type", "state", "time [s]", "closest", "lap", ""))
+        for r in records:
+            flag = "" if r["ok"] else "  (bad checksum)"
+            print("%(seq)4d  %(type)-10s %(state)5d %(time_s)9.2f %(closest)8d %(lap)4d  %(detail)s" % r + flag)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
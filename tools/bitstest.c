@@ -0,0 +1,171 @@
+/*
+
+Host test of the register and bit-field macros (libraries/bits.h)
+
+The "registers" are plain uint8_t variables, as the header allows, set to a
+known pattern before each access so that a macro touching a bit outside its
+own shows up. It checks:
+
+    bits       BIT() and MASK() at positions 0 and 7 and the full width 8
+    pins       pin_set/clr/test/toggle/write at bits 0 and 7, in a register
+               of zeros and of ones, every other bit left as it was
+    fields     field_get/put/mask at position 0 width 8, position 7 width 1
+               and in the middle; a value wider than the field is cut to it
+    words      word_hi/lo/make/set_hi/set_lo at 0x0000, 0xFFFF and a signed
+               value; dword_byte for bytes 0..3
+    always.h   bits_on/bits_off with an expression for the mask
+
+It prints the failed checks and a count, and exits with 1 if any failed.
+
+Build and run from the repository root:
+    cc -O2 -I libraries tools/bitstest.c -o bitstest
+    ./bitstest
+
+*/
+
+#include <stdio.h>
+
+#include "always.h"
+#include "bits.h"
+
+static int checks, failed;
+
+static void check_eq(const char *what, long value, long expected) {
+    checks++;
+    if (value != expected) {
+        failed++;
+        printf("FAIL %s: 0x%lX, expected 0x%lX\n", what, value, expected);
+    }
+}
+
+#define CHECK_EQ(what, value, expected) check_eq(what, (long)(value), (long)(expected))
+
+static uint8_t reg;  // stands for an SFR
+
+#define PIN_LOW reg, 0
+#define PIN_HIGH reg, 7
+#define FIELD_ALL reg, 0, 8
+#define FIELD_TOP reg, 7, 1
+#define FIELD_MID reg, 3, 2
+
+static void test_bits(void) {
+    CHECK_EQ("BIT(0)", BIT(0), 0x01);
+    CHECK_EQ("BIT(7)", BIT(7), 0x80);
+    CHECK_EQ("MASK(0, 8)", MASK(0, 8), 0xFF);
+    CHECK_EQ("MASK(7, 1)", MASK(7, 1), 0x80);
+    CHECK_EQ("MASK(0, 1)", MASK(0, 1), 0x01);
+    CHECK_EQ("MASK(3, 2)", MASK(3, 2), 0x18);
+    CHECK_EQ("MASK(1, 7)", MASK(1, 7), 0xFE);
+}
+
+static void test_pins(void) {
+    reg = 0x00;
+    pin_set(PIN_LOW);
+    CHECK_EQ("pin_set bit 0", reg, 0x01);
+    pin_set(PIN_HIGH);
+    CHECK_EQ("pin_set bit 7", reg, 0x81);
+    CHECK_EQ("pin_test bit 0 set", pin_test(PIN_LOW), 1);
+    CHECK_EQ("pin_test bit 7 set", pin_test(PIN_HIGH), 1);
+    pin_clr(PIN_HIGH);
+    CHECK_EQ("pin_clr bit 7", reg, 0x01);
+    CHECK_EQ("pin_test bit 7 clear", pin_test(PIN_HIGH), 0);
+
+    reg = 0xFF;
+    pin_clr(PIN_LOW);
+    CHECK_EQ("pin_clr bit 0 of ones", reg, 0xFE);
+    CHECK_EQ("pin_test bit 0 clear", pin_test(PIN_LOW), 0);
+    pin_toggle(PIN_LOW);
+    CHECK_EQ("pin_toggle bit 0", reg, 0xFF);
+    pin_toggle(PIN_HIGH);
+    CHECK_EQ("pin_toggle bit 7", reg, 0x7F);
+
+    reg = 0x5A;
+    pin_write(PIN_HIGH, 1);
+    CHECK_EQ("pin_write bit 7 = 1", reg, 0xDA);
+    pin_write(PIN_HIGH, 0);
+    CHECK_EQ("pin_write bit 7 = 0", reg, 0x5A);
+    pin_write(PIN_LOW, 2);  // any non-zero value sets
+    CHECK_EQ("pin_write bit 0 = 2", reg, 0x5B);
+    if (reg)
+        pin_write(PIN_LOW, 0);  // do { } while (0): safe under an if without braces
+    else
+        reg = 0;
+    CHECK_EQ("pin_write under if", reg, 0x5A);
+}
+
+static void test_fields(void) {
+    reg = 0xA5;
+    CHECK_EQ("field_get pos 0 width 8", field_get(FIELD_ALL), 0xA5);
+    CHECK_EQ("field_get pos 7 width 1", field_get(FIELD_TOP), 1);
+    CHECK_EQ("field_get pos 3 width 2", field_get(FIELD_MID), 0);
+    CHECK_EQ("field_mask pos 0 width 8", field_mask(FIELD_ALL), 0xFF);
+    CHECK_EQ("field_mask pos 7 width 1", field_mask(FIELD_TOP), 0x80);
+    CHECK_EQ("field_mask pos 3 width 2", field_mask(FIELD_MID), 0x18);
+
+    field_put(FIELD_ALL, 0x3C);
+    CHECK_EQ("field_put pos 0 width 8", reg, 0x3C);
+
+    reg = 0x00;
+    field_put(FIELD_TOP, 1);
+    CHECK_EQ("field_put pos 7 width 1", reg, 0x80);
+    field_put(FIELD_TOP, 2);  // wider than the field: bit 0 of it, 0
+    CHECK_EQ("field_put pos 7, value cut", reg, 0x00);
+
+    reg = 0xFF;
+    field_put(FIELD_MID, 0);
+    CHECK_EQ("field_put pos 3 width 2 of ones", reg, 0xE7);
+    field_put(FIELD_MID, 2);
+    CHECK_EQ("field_put pos 3 width 2 = 2", reg, 0xF7);
+    field_put(FIELD_MID, 0xFD);  // cut to 0b01
+    CHECK_EQ("field_put pos 3 width 2, value cut", reg, 0xEF);
+    CHECK_EQ("field_get after field_put", field_get(FIELD_MID), 1);
+}
+
+static void test_words(void) {
+    uint16_t w = 0x1234;
+    int16_t s = -2;
+    uint32_t d = 0x12345678UL;
+    int32_t neg = -1;
+
+    CHECK_EQ("word_hi", word_hi(w), 0x12);
+    CHECK_EQ("word_lo", word_lo(w), 0x34);
+    CHECK_EQ("word_hi of 0xFFFF", word_hi(0xFFFFu), 0xFF);
+    CHECK_EQ("word_lo of 0", word_lo(0), 0x00);
+    CHECK_EQ("word_hi of -2", word_hi(s), 0xFF);
+    CHECK_EQ("word_lo of -2", word_lo(s), 0xFE);
+    CHECK_EQ("word_make", word_make(0xAB, 0xCD), 0xABCD);
+    CHECK_EQ("word_make, wide bytes cut", word_make(0x1FF, 0x100), 0xFF00);
+    word_set_lo(w, 0xAA);
+    CHECK_EQ("word_set_lo", w, 0x12AA);
+    word_set_hi(w, 0x00);
+    CHECK_EQ("word_set_hi", w, 0x00AA);
+    w = 0xFFFF;
+    word_set_lo(w, 0);
+    CHECK_EQ("word_set_lo of 0xFFFF", w, 0xFF00);
+
+    CHECK_EQ("dword_byte 0", dword_byte(d, 0), 0x78);
+    CHECK_EQ("dword_byte 1", dword_byte(d, 1), 0x56);
+    CHECK_EQ("dword_byte 2", dword_byte(d, 2), 0x34);
+    CHECK_EQ("dword_byte 3", dword_byte(d, 3), 0x12);
+    CHECK_EQ("dword_byte 3 of -1", dword_byte(neg, 3), 0xFF);
+    CHECK_EQ("dword_byte 0 of 0x100", dword_byte(0x100UL, 0), 0x00);
+}
+
+static void test_always(void) {
+    uint8_t x = 0x01;
+
+    bits_on(x, 0x04 | 0x80);
+    CHECK_EQ("bits_on with an expression", x, 0x85);
+    bits_off(x, 0x01 | 0x80);
+    CHECK_EQ("bits_off with an expression", x, 0x04);
+}
+
+int main(void) {
+    test_bits();
+    test_pins();
+    test_fields();
+    test_words();
+    test_always();
+    printf("bitstest: %d checks, %d failed\n", checks, failed);
+    return failed != 0;
+}
@@ -0,0 +1,268 @@
+/*
+
+Host simulation of the two-cart convoy (libraries/convoy.h)
+
+Two carts on a straight line, one behind the other, each running the
+firmware's own code: the lead broadcasts with libraries/convoy.c over the
+real libraries/link.c, the follower tracks the lead with its proximity
+sensor (libraries/ttc.c) and the broadcasts. The carts are joined by a
+simulated point-to-point serial line with random bit errors, which can also
+be cut for a while to see the follower fall back to the sensor alone and
+pick the broadcasts up again.
+
+The lead drives a fixed schedule of speeds with stops; both carts have the
+same model: ramped speed commands, a first-order wheel lag, encoders that
+count 48 steps per wheel turn, and the GP2D120 with noise. Each case runs
+the same schedule and reports:
+
+    gap        mean and smallest gap between the carts, mm (0 = they hit)
+    error      RMS of the follower's gap error, mm, against the gap it wants
+    range      % of the time the lead was beyond the sensor's range
+    linked     % of the time the follower had the broadcasts
+    rx, lost   broadcasts taken and lost
+
+The cases are: with the link, with the proximity sensor only (the lead
+never broadcasts), and with the link cut between the --outage times.
+
+Build and run from the repository root:
+    cc -O2 -I libraries tools/convoysim.c libraries/convoy.c libraries/ttc.c libraries/link.c -lm -o convoysim
+    ./convoysim
+    ./convoysim -e 1e-4 --outage 20:26 -t 120
+
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "convoy.h"
+#include "link.h"
+#include "odometry.h"  // wheel geometry
+#include "ttc.h"
+
+// Must match "4 - autonomous task/main.c"
+#define CONTROL_DT_MS 40
+#define LEAD_ADDR 1
+#define FOLLOW_ADDR 2
+
+// Cart model, as in tools/tracksim.c
+#define ACCEL_MMPS2 1500.0   // speed command ramps
+#define DECEL_MMPS2 2500.0
+#define TOP_MMPS 800.0       // TTC_MMPS_FULL
+#define MOTOR_TAU_MS 60.0    // wheel speed lag
+#define NEAR_NOISE 3.0       // proximity reading noise, ADC counts (1 sigma)
+#define START_GAP_MM 150.0
+
+// Lead schedule, repeated: from this second on, this speed
+static const double schedule[][2] = {
+    {0, 0}, {1, 500}, {6, 250}, {10, 600}, {14, 0}, {17, 400}, {22, 650}, {26, 0},
+};
+#define SCHEDULE_S 30.0
+
+struct cart {
+    double x;      // front (follower) or back (lead) position, mm
+    double v;      // mm/s
+    double cmd;    // ramped speed command, mm/s
+    long counts;   // encoder
+    long last_counts;
+    int speed;     // measured over the last control tick, mm/s
+};
+
+struct result {
+    double gap_sum, gap_min, err2_sum;
+    long samples, out_of_range, linked;
+    unsigned received, missed;
+};
+
+struct node {
+    struct link link;  // first, so link_tx_start() can find the node
+    struct link_io io;
+    char txie;
+};
+
+static struct node nodes[2];
+
+void link_tx_start(struct link *lk) {
+    ((struct node *)lk)->txie = 1;
+}
+
+static double uniform(void) {
+    return rand() / (RAND_MAX + 1.0);
+}
+
+static double gauss(void) {
+    double u = uniform() + 1e-12, v = uniform();
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static int corrupt(int c, double ber) {
+    int bit;
+
+    if (ber <= 0) return c;
+    for (bit = 0; bit < 10; bit++) {
+        if (uniform() < ber) {
+            if (bit == 0 || bit == 9) return -1;  // framing error, byte lost
+            c ^= 1 << (bit - 1);
+        }
+    }
+    return c;
+}
+
+// GP2D120: inverse of the calibration in ttc.h
+static int near_read(double range) {
+    double v;
+
+    if (range < 30) range = 30;
+    if (range > 400) range = 400;
+    v = TTC_CAL_M / (range + TTC_CAL_K) - TTC_CAL_B + gauss() * NEAR_NOISE;
+    return v < 0 ? 0 : v > 1023 ? 1023 : (int)v;
+}
+
+static double lead_target(double t) {
+    double s = fmod(t, SCHEDULE_S), v = 0;
+    size_t i;
+
+    for (i = 0; i < sizeof schedule / sizeof schedule[0]; i++)
+        if (s >= schedule[i][0]) v = schedule[i][1];
+    return v;
+}
+
+// One ms of a cart: ramp the command, wheel lag, encoder
+static void move(struct cart *c, double target) {
+    double step;
+
+    if (target > TOP_MMPS) target = TOP_MMPS;
+    step = target - c->cmd;
+    if (step > ACCEL_MMPS2 / 1000) step = ACCEL_MMPS2 / 1000;
+    if (step < -DECEL_MMPS2 / 1000) step = -DECEL_MMPS2 / 1000;
+    c->cmd += step;
+    c->v += (c->cmd - c->v) / MOTOR_TAU_MS;
+    c->x += c->v / 1000;
+    c->counts = (long)floor(c->x * 256 / ODO_MM_PER_PULSE_Q8);
+}
+
+static void measure(struct cart *c) {
+    c->speed = (int)((c->counts - c->last_counts) * ODO_MM_PER_PULSE_Q8 * (1000 / CONTROL_DT_MS) / 256);
+    c->last_counts = c->counts;
+}
+
+static struct result simulate(int use_link, long baud, double ber, double seconds, double cut_from, double cut_to) {
+    struct result r;
+    struct cart lead, follower;
+    double byte_us = 10e6 / baud, now_us = 0, next_ms = 1000, target = TOP_MMPS;
+    uint8_t data[LINK_MAX_PAYLOAD], src;
+    long ms = 0;
+    int i, c, len, tx[2];
+
+    memset(&r, 0, sizeof r);
+    r.gap_min = 1e9;
+    memset(nodes, 0, sizeof nodes);
+    memset(&lead, 0, sizeof lead);
+    memset(&follower, 0, sizeof follower);
+    lead.x = START_GAP_MM;
+    link_init(&nodes[0].link, &nodes[0].io, LEAD_ADDR);
+    link_init(&nodes[1].link, &nodes[1].io, FOLLOW_ADDR);
+    ttc_init();
+    convoy_init();
+
+    while (now_us < seconds * 1e6) {
+        // Main loops
+        link_poll(&nodes[0].link);
+        while ((len = link_recv(&nodes[1].link, &src, data)) >= 0) convoy_receive(data, (uint8_t)len);
+        link_poll(&nodes[1].link);
+
+        // UARTs, full duplex; the line is cut between cut_from and cut_to
+        for (i = 0; i < 2; i++) {
+            tx[i] = -1;
+            if (nodes[i].txie) {
+                tx[i] = link_tx_next(&nodes[i].io);
+                if (tx[i] < 0) nodes[i].txie = 0;
+            }
+        }
+        if (now_us < cut_from * 1e6 || now_us >= cut_to * 1e6) {
+            for (i = 0; i < 2; i++) {
+                if (tx[1 - i] >= 0 && (c = corrupt(tx[1 - i], ber)) >= 0) link_rx_byte(&nodes[i].io, (uint8_t)c);
+            }
+        }
+
+        now_us += byte_us;
+        while (now_us >= next_ms) {
+            double gap;
+
+            next_ms += 1000;
+            ms++;
+            link_tick(&nodes[0].link, 1);
+            link_tick(&nodes[1].link, 1);
+
+            // Control ticks
+            if (ms % CONTROL_DT_MS == 0) {
+                measure(&lead);
+                measure(&follower);
+                if ((len = convoy_lead((int16_t)lead.speed, data)) != 0 && use_link)
+                    link_send(&nodes[0].link, LINK_BROADCAST, data, (uint8_t)len);
+
+                gap = lead.x - follower.x;
+                ttc_update((int16_t)near_read(gap), (int16_t)follower.speed);
+                target = ttc_speed_limit();
+                c = convoy_follow(ttc_distance(), ttc_closing(), (int16_t)follower.speed);
+                if (c < target) target = c;
+
+                r.samples++;
+                r.gap_sum += gap;
+                r.err2_sum += (double)convoy_gap_error() * convoy_gap_error();
+                if (gap > TTC_RANGE_MM) r.out_of_range++;
+                if (convoy_linked()) r.linked++;
+            }
+
+            move(&lead, lead_target(ms / 1000.0));
+            move(&follower, target);
+            gap = lead.x - follower.x;
+            if (gap < r.gap_min) r.gap_min = gap;
+            if (gap < 0) follower.x = lead.x;  // pushed along
+        }
+    }
+    r.received = convoy_received();
+    r.missed = convoy_missed();
+    return r;
+}
+
+static void print_result(const char *name, const struct result *r) {
+    printf("%-12s %8.0f %8.0f %8.1f %7.1f %7.1f %6u %6u\n", name, r->gap_sum / r->samples,
+           r->gap_min < 0 ? 0 : r->gap_min, sqrt(r->err2_sum / r->samples), 100.0 * r->out_of_range / r->samples,
+           100.0 * r->linked / r->samples, r->received, r->missed);
+}
+
+int main(int argc, char **argv) {
+    long baud = 19200;
+    double ber = 0, seconds = 60, cut_from = 20, cut_to = 26;
+    struct result r;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-b") && i + 1 < argc) baud = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-e") && i + 1 < argc) ber = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc) seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc) srand((unsigned)atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--outage") && i + 1 < argc) {
+            if (sscanf(argv[++i], "%lf:%lf", &cut_from, &cut_to) != 2 || cut_to < cut_from) {
+                fprintf(stderr, "--outage: expected from:to, in seconds\n");
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "usage: %s [-b baud] [-e bit_error_rate] [-t seconds] [-s seed] [--outage from:to]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    printf("%-12s %8s %8s %8s %7s %7s %6s %6s\n", "case", "gap_mm", "min_mm", "err_mm", "range%", "linked%", "rx",
+           "lost");
+    r = simulate(1, baud, ber, seconds, 0, 0);
+    print_result("link", &r);
+    r = simulate(0, baud, ber, seconds, 0, 0);
+    print_result("proximity", &r);
+    r = simulate(1, baud, ber, seconds, cut_from, cut_to);
+    print_result("outage", &r);
+    return 0;
+}
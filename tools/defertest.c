@@ -0,0 +1,175 @@
+/*
+
+Host test of the deferred-event ring (libraries/defer.h)
+
+Runs the real defer.c with the interrupt side played by plain calls to
+defer_post() and checks, for every step, what the main loop's
+defer_dispatch() hands to the handlers:
+
+    order      events come out oldest first, with their argument
+    full       DEFER_RING events fit; the next ones are dropped, counted
+               against their type, and the ring still holds the first ones
+    drain      a full ring empties in one defer_dispatch()
+    wrap       thousands of rounds, so the free-running indices wrap
+    nested     an event posted while a handler runs (the interrupt firing
+               during dispatch) is handled in the same call
+    counters   high-water mark, saturating drop counts, defer_init() clears
+               them; types out of range are neither handled nor counted
+
+It prints the failed checks and a count, and exits with 1 if any failed.
+The cycles defer_post() takes on the PIC are in the XC8 listing
+(tools/memory_report.py), not here.
+
+Build and run from the repository root:
+    cc -O2 -I libraries tools/defertest.c libraries/defer.c -o defertest
+    ./defertest
+
+*/
+
+#include <stdio.h>
+
+#include "defer.h"
+
+#define LOG_SIZE 64
+
+static struct {
+    uint8_t type, arg;
+} log_[LOG_SIZE];
+static int logged;
+static int checks, failed;
+static int nest;  // events the handler of type 2 still posts
+
+static void record(uint8_t type, uint8_t arg) {
+    if (logged < LOG_SIZE) {
+        log_[logged].type = type;
+        log_[logged].arg = arg;
+    }
+    logged++;
+}
+
+static void on_0(uint8_t arg) { record(0, arg); }
+static void on_1(uint8_t arg) { record(1, arg); }
+
+static void on_2(uint8_t arg) {
+    record(2, arg);
+    if (nest > 0) {
+        nest--;
+        defer_post(2, (uint8_t)(arg + 1));
+    }
+}
+
+static void check_eq(const char *what, long value, long expected) {
+    checks++;
+    if (value != expected) {
+        failed++;
+        printf("FAIL %s: %ld, expected %ld\n", what, value, expected);
+    }
+}
+
+#define CHECK_EQ(what, value, expected) check_eq(what, (long)(value), (long)(expected))
+
+static void reset(void) {
+    defer_init();
+    defer_register(0, on_0);
+    defer_register(1, on_1);
+    defer_register(2, on_2);
+    logged = 0;
+    nest = 0;
+}
+
+static void test_order(void) {
+    reset();
+    CHECK_EQ("empty dispatch", defer_dispatch(), 0);
+    defer_post(1, 10);
+    defer_post(0, 11);
+    defer_post(1, 12);
+    CHECK_EQ("waiting", defer_waiting(), 3);
+    CHECK_EQ("dispatched", defer_dispatch(), 3);
+    CHECK_EQ("handled", logged, 3);
+    CHECK_EQ("first type", log_[0].type, 1);
+    CHECK_EQ("first arg", log_[0].arg, 10);
+    CHECK_EQ("second type", log_[1].type, 0);
+    CHECK_EQ("second arg", log_[1].arg, 11);
+    CHECK_EQ("third arg", log_[2].arg, 12);
+    CHECK_EQ("waiting after", defer_waiting(), 0);
+}
+
+static void test_full_and_drain(void) {
+    int i, ok = 1;
+
+    reset();
+    for (i = 0; i < DEFER_RING; i++) CHECK_EQ("post into room", defer_post(0, (uint8_t)i), 1);
+    CHECK_EQ("waiting when full", defer_waiting(), DEFER_RING);
+    CHECK_EQ("high water when full", defer_high_water(), DEFER_RING);
+    for (i = 0; i < 3; i++) CHECK_EQ("post into a full ring", defer_post(1, 99), 0);
+    CHECK_EQ("drops of type 1", defer_overruns(1), 3);
+    CHECK_EQ("drops of type 0", defer_overruns(0), 0);
+    CHECK_EQ("waiting after drops", defer_waiting(), DEFER_RING);
+
+    CHECK_EQ("drain", defer_dispatch(), DEFER_RING);
+    for (i = 0; i < DEFER_RING; i++) ok &= log_[i].type == 0 && log_[i].arg == i;
+    CHECK_EQ("drained in order, none of the dropped", ok, 1);
+    CHECK_EQ("waiting after drain", defer_waiting(), 0);
+    CHECK_EQ("high water kept", defer_high_water(), DEFER_RING);
+    CHECK_EQ("room again", defer_post(0, 0), 1);
+}
+
+static void test_wrap(void) {
+    int round, i, n, ok = 1;
+    uint8_t next = 0, expect = 0;
+
+    reset();
+    for (round = 0; round < 5000; round++) {
+        n = round % DEFER_RING + 1;
+        logged = 0;
+        for (i = 0; i < n; i++) defer_post(1, next++);
+        ok &= defer_dispatch() == n && logged == n;
+        for (i = 0; i < n; i++) ok &= log_[i].arg == expect++;
+    }
+    CHECK_EQ("5000 rounds in order across index wrap", ok, 1);
+    CHECK_EQ("no drops while keeping up", defer_overruns(1), 0);
+}
+
+static void test_nested(void) {
+    reset();
+    nest = 3;
+    defer_post(2, 40);
+    CHECK_EQ("posted during dispatch, handled in the same call", defer_dispatch(), 4);
+    CHECK_EQ("last nested arg", log_[3].arg, 43);
+    CHECK_EQ("nothing left", defer_waiting(), 0);
+}
+
+static void test_counters(void) {
+    int i;
+
+    reset();
+    for (i = 0; i < DEFER_RING; i++) defer_post(0, 0);
+    for (i = 0; i < 300; i++) defer_post(2, 0);
+    CHECK_EQ("drops saturate", defer_overruns(2), 255);
+    CHECK_EQ("type out of range, no count", defer_overruns(DEFER_TYPES), 0);
+    defer_dispatch();
+    logged = 0;
+    defer_post(DEFER_TYPES, 1);  // no handler can be registered for it
+    defer_post(3, 2);            // in range, none registered
+    CHECK_EQ("unhandled types still leave the ring", defer_dispatch(), 2);
+    CHECK_EQ("and reach no handler", logged, 0);
+
+    defer_init();
+    CHECK_EQ("init clears drops", defer_overruns(2), 0);
+    CHECK_EQ("init clears high water", defer_high_water(), 0);
+    defer_post(0, 0);
+    defer_post(0, 0);
+    CHECK_EQ("high water of two", defer_high_water(), 2);
+    defer_dispatch();  // no handlers after defer_init()
+    CHECK_EQ("handlers cleared by init", logged, 0);
+}
+
+int main(void) {
+    test_order();
+    test_full_and_drain();
+    test_wrap();
+    test_nested();
+    test_counters();
+    printf("defertest: %d checks, %d failed\n", checks, failed);
+    return failed != 0;
+}
@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""Charge used per run with and without power management (libraries/power.h).
+
+Steps a session through 5 ms Timer 0 ticks, the way the firmware does, and
+adds up the charge drawn by each part of the cart in two versions of the
+program:
+
+  before  sensor supply always on, CPU always running, status LED toggled
+          (50 % on) while the line is lost, RGB LED left lit when stopped,
+          buzzer beeps with a blocking delay
+  after   sensor supply on only while running (or, for the sensor read
+          program, for the 40 ms warm-up before each sample), LED flashes
+          20 ms every 500 ms, RGB LED off when stopped, CPU asleep after
+          60 s without a key press or command
+
+A session of the autonomous task is: power-up, --wait seconds stopped, a run
+of --run seconds with the line lost --lost of the time, then --after seconds
+stopped. The sensor read program takes 10 samples 250 ms apart after each of
+--presses key presses, --wait seconds apart.
+
+The currents are estimates for the cart's parts, in mA; measure yours and
+pass them with --current, e.g. --current sensors=62 --current board=11.
+Motor current is not simulated; --motor gives the average motor current
+while running, to show the saving against the whole battery drain.
+
+    tools/energy_model.py
+    tools/energy_model.py --run 90 --after 600 --current sensors=60
+    tools/energy_model.py --program sensor-read --presses 20 --wait 30
+"""
+
+import argparse
+import sys
+
+TICK_MS = 5
+WARMUP_MS = 40     # POWER_WARMUP_MS
+FLASH_MS = 20      # POWER_FLASH_MS
+BLINK_MS = 500     # POWER_BLINK_MS
+IDLE_S = 60        # POWER_IDLE_S
+CONTROL_DT_MS = 40
+BEEP_MS = 200
+
+CURRENTS = {
+    "cpu": 4.0,        # PIC16F886 at 20 MHz and its oscillator
+    "cpu_sleep": 0.05, # PIC asleep, watchdog running
+    "board": 8.0,      # LCD module and regulators, always on
+    "sensors": 75.0,   # 3 line-sensor IR emitters and the proximity sensor
+    "led": 10.0,       # status LED
+    "rgb": 15.0,       # RGB LED, one colour
+    "buzzer": 25.0,
+}
+
+PARTS = ("cpu", "board", "sensors", "led", "rgb", "buzzer")
+
+
+def autonomous_session(args, managed):
+    """Yields, per tick, the set of parts that are on and whether the CPU sleeps."""
+    wait = int(args.wait * 1000 / TICK_MS)
+    run = int(args.run * 1000 / TICK_MS)
+    after = int(args.after * 1000 / TICK_MS)
+    lost_every = int(1 / args.lost) if args.lost > 0 else 0
+    idle_ticks = IDLE_S * 1000 // TICK_MS
+    beep = BEEP_MS // TICK_MS
+
+    tick = 0
+    for phase, length in (("wait", wait), ("run", run), ("after", after)):
+        idle = 0
+        for i in range(length):
+            on = {"board"}
+            asleep = False
+            running = phase == "run"
+            lost = running and lost_every and (i // (1000 // TICK_MS)) % lost_every == 0  # whole seconds lost
+
+            if tick < beep:
+                on.add("buzzer")
+                on.add("sensors")  # the buzzer needs the sensor supply
+            if managed:
+                if running:
+                    on.add("sensors")
+                    on.add("rgb")
+                    if lost and (i % (BLINK_MS // TICK_MS)) < FLASH_MS // TICK_MS:
+                        on.add("led")
+                else:
+                    idle += 1
+                    asleep = idle >= idle_ticks
+            else:
+                on.add("sensors")
+                if running or phase == "after":
+                    on.add("rgb")  # the last colour stays lit
+                if lost and i % 2 == 0:
+                    on.add("led")  # toggled every main loop pass: about half the time
+            if not asleep:
+                on.add("cpu")
+            yield on, asleep
+            tick += 1
+
+
+def sensor_read_session(args, managed):
+    period = 250 // TICK_MS
+    warm = WARMUP_MS // TICK_MS
+    gap = int(args.wait * 1000 / TICK_MS)
+    idle_ticks = IDLE_S * 1000 // TICK_MS
+    beep = 300 // TICK_MS
+
+    for press in range(args.presses):
+        for i in range(gap):
+            on = {"board"}
+            asleep = False
+            sampling = i < 10 * period
+            if i < beep:
+                on.update(("buzzer", "sensors"))
+            if managed:
+                if sampling and (i % period) >= period - warm:
+                    on.add("sensors")
+                asleep = i >= 10 * period + idle_ticks
+            else:
+                on.add("sensors")
+            if not asleep:
+                on.add("cpu")
+            yield on, asleep
+
+
+def simulate(args, managed):
+    session = autonomous_session if args.program == "autonomous" else sensor_read_session
+    charge = dict.fromkeys(PARTS, 0.0)  # mA * ticks
+    ticks = 0
+    for on, asleep in session(args, managed):
+        ticks += 1
+        for part in on:
+            charge[part] += args.currents[part]
+        if asleep:
+            charge["cpu"] += args.currents["cpu_sleep"]
+    hours_per_tick = TICK_MS / 3600000.0
+    return {part: c * hours_per_tick for part, c in charge.items()}, ticks * TICK_MS / 1000.0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--program", choices=("autonomous", "sensor-read"), default="autonomous")
+    parser.add_argument("--wait", type=float, default=120, help="s stopped before the run (sensor read: between presses)")
+    parser.add_argument("--run", type=float, default=60, help="s running")
+    parser.add_argument("--after", type=float, default=300, help="s stopped after the run")
+    parser.add_argument("--lost", type=float, default=0.1, help="fraction of the run with the line lost")
+    parser.add_argument("--presses", type=int, default=10, help="sensor read: key presses")
+    parser.add_argument("--motor", type=float, default=600, help="average motor current while running, mA")
+    parser.add_argument("--current", action="append", default=[], metavar="PART=MA",
+                        help="override a current: " + ", ".join(sorted(CURRENTS)))
+    args = parser.parse_args()
+
+    args.currents = dict(CURRENTS)
+    for item in args.current:
+        name, _, value = item.partition("=")
+        if name not in CURRENTS:
+            parser.error("unknown part %r" % name)
+        args.currents[name] = float(value)
+
+    before, seconds = simulate(args, managed=False)
+    after, _ = simulate(args, managed=True)
+
+    print("%s session of %.0f s" % (args.program, seconds))
+    print("%-10s %10s %10s %10s" % ("part", "before", "after", "saved"))
+    for part in PARTS:
+        print("%-10s %8.2f mAh %6.2f mAh %6.2f mAh" % (part, before[part], after[part], before[part] - after[part]))
+    total_before, total_after = sum(before.values()), sum(after.values())
+    print("%-10s %8.2f mAh %6.2f mAh %6.2f mAh (%.0f %%)" % ("total", total_before, total_after,
+                                                            total_before - total_after,
+                                                            100.0 * (total_before - total_after) / total_before))
+    if args.program == "autonomous" and args.motor > 0:
+        motors = args.motor * args.run / 3600.0
+        print("motors %.2f mAh: the saving is %.0f %% of the whole session's drain" %
+              (motors, 100.0 * (total_before - total_after) / (total_before + motors)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
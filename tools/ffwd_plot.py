@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""Plot and compare motor characterization runs (libraries/mchar.h).
+
+A run is the text the cart prints after 'C' on the serial channel: one
+"S,duty,speed1,speed2,rise1,rise2" line per duty step, then the fit
+("F,..."), the feed-forward table ("T,...") and the top speed ("V,...").
+Give several captures to compare them, e.g. before and after a motor swap,
+or on a fresh and on a tired battery:
+
+    tools/ffwd_plot.py run1.txt run2.txt          # summary + plot
+    tools/ffwd_plot.py --port /dev/ttyUSB0 -o new.txt
+    tools/ffwd_plot.py --no-plot run1.txt
+
+The plot (needs matplotlib) shows speed against duty cycle for both wheels
+of every run, with the fitted lines, and the rise time of each step.
+"""
+
+import argparse
+import os
+import sys
+
+
+def parse(lines):
+    run = {"steps": [], "fit": {}, "table": {}, "top": None, "ok": False}
+    for line in lines:
+        f = line.strip().split(",")
+        try:
+            if f[0] == "S" and len(f) == 6:
+                run["steps"].append(tuple(int(x) for x in f[1:]))
+            elif f[0] == "F" and len(f) == 4:
+                run["fit"][int(f[1])] = (int(f[2]), int(f[3]) / 256.0)
+            elif f[0] == "T":
+                run["table"][int(f[1])] = [int(x) for x in f[2:]]
+            elif f[0] == "V":
+                run["top"] = int(f[1])
+            elif f[0] == "END":
+                run["ok"] = True
+        except (ValueError, IndexError):
+            continue  # noise on the line
+    return run
+
+
+def read_port(port, baud, output):
+    import serial  # pyserial
+
+    lines = []
+    with serial.Serial(port, baud, timeout=15) as link:
+        link.reset_input_buffer()
+        link.write(b"C")
+        while True:
+            line = link.readline().decode("ascii", "replace")
+            if not line:
+                raise ValueError("no answer from the cart")
+            lines.append(line)
+            if line.strip() in ("END", "ERR"):
+                break
+    if output:
+        with open(output, "w") as f:
+            f.writelines(lines)
+    return lines
+
+
+def summary(name, run):
+    print("%s:%s" % (name, "" if run["ok"] else " (incomplete)"))
+    for wheel in (1, 2):
+        if wheel in run["fit"]:
+            dead, gain = run["fit"][wheel]
+            rises = [s[2 + wheel] for s in run["steps"] if s[2 + wheel] >= 0]
+            rise = "%d ms" % (sum(rises) / len(rises)) if rises else "-"
+            print("  wheel %d: dead band %4d, gain %6.2f counts/s per duty, mean rise %s" % (wheel, dead, gain, rise))
+    if len(run["fit"]) == 2:
+        g1, g2 = run["fit"][1][1], run["fit"][2][1]
+        print("  gain mismatch %.1f %%" % (100.0 * (g1 - g2) / max(g1, g2)))
+    if run["top"]:
+        print("  top speed both wheels reach: %d counts/s" % run["top"])
+    for wheel, table in sorted(run["table"].items()):
+        print("  table %d: %s" % (wheel, " ".join("%4d" % d for d in table)))
+
+
+def plot(runs):
+    import matplotlib.pyplot as plt
+
+    fig, (ax_speed, ax_rise) = plt.subplots(1, 2, figsize=(12, 5))
+    for name, run in runs:
+        duty = [s[0] for s in run["steps"]]
+        for wheel, style in ((1, "-"), (2, "--")):
+            label = "%s wheel %d" % (name, wheel)
+            line, = ax_speed.plot(duty, [s[wheel] for s in run["steps"]], style + "o", markersize=3, label=label)
+            if wheel in run["fit"]:
+                dead, gain = run["fit"][wheel]
+                ax_speed.plot([dead, 1023], [0, gain * (1023 - dead)], ":", color=line.get_color())
+            rise = [(s[0], s[2 + wheel]) for s in run["steps"] if s[2 + wheel] >= 0]
+            if rise:
+                ax_rise.plot(*zip(*rise), style + "o", markersize=3, color=line.get_color(), label=label)
+    ax_speed.set_xlabel("duty cycle")
+    ax_speed.set_ylabel("speed (counts/s)")
+    ax_speed.set_title("Steady speed, dotted: fit")
+    ax_speed.legend(fontsize="small")
+    ax_rise.set_xlabel("duty cycle")
+    ax_rise.set_ylabel("rise time (ms)")
+    ax_rise.set_title("Rise time of each step")
+    fig.tight_layout()
+    plt.show()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("files", nargs="*", help="captured runs")
+    parser.add_argument("--port", help="run a characterization on the cart through this serial port")
+    parser.add_argument("--baud", type=int, default=19200)
+    parser.add_argument("-o", "--output", help="save the run read from --port")
+    parser.add_argument("--no-plot", action="store_true", help="only print the summary")
+    args = parser.parse_args()
+
+    runs = []
+    if args.port:
+        runs.append((args.port, parse(read_port(args.port, args.baud, args.output))))
+    for path in args.files:
+        with open(path) as f:
+            runs.append((os.path.basename(path), parse(f)))
+    if not runs:
+        runs.append(("stdin", parse(sys.stdin)))
+
+    for name, run in runs:
+        summary(name, run)
+    if not args.no_plot:
+        try:
+            plot(runs)
+        except ImportError:
+            print("matplotlib not installed, no plot", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,238 @@
+/*
+
+Host simulation of the USART packet link (libraries/link.h)
+
+Runs several nodes in one program, each with the real link.c, connected by
+simulated UART lines with random bit errors, and measures goodput and
+latency. Two nodes are wired point to point (each TX to the other's RX,
+full duplex); three or more share one half-duplex bus where overlapping
+bytes collide.
+
+Every node keeps sending 8-byte messages to another node as fast as its
+window allows. Each message carries its send time and a counter, so the
+receiver can measure latency and detect duplicates and reordering. The link
+delivers every frame once but not always in order, so a late frame counts as
+reordered, not as a duplicate.
+
+Build and run from the repository root:
+    cc -O2 -I libraries tools/linksim.c libraries/link.c -o linksim
+    ./linksim -n 2 -b 19200 -e 1e-4 -t 60
+    ./linksim --sweep
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "link.h"
+
+#define MAX_NODES 8
+
+struct node {
+    struct link link;  // first, so link_tx_start() can find the node
+    struct link_io io;
+    char txie;         // transmit interrupt enabled
+    int tx_byte;       // byte on the line, -1 = idle
+    uint32_t sent_count;
+    uint32_t next_count[MAX_NODES];  // one past the highest counter received from each node
+    uint32_t seen[MAX_NODES];        // bit i: counter next_count - 1 - i received
+    uint8_t pending[LINK_MAX_PAYLOAD];
+    char has_pending;
+};
+
+struct result {
+    double goodput;  // payload bytes/s delivered once
+    double latency_mean_ms;
+    double latency_max_ms;
+    unsigned long delivered;
+    unsigned long duplicates;
+    unsigned long reordered;
+    unsigned long crc_errors;
+    unsigned long retransmits;
+    unsigned long failures;
+};
+
+static struct node nodes[MAX_NODES];
+
+void link_tx_start(struct link *lk) {
+    ((struct node *)lk)->txie = 1;
+}
+
+static double uniform(void) {
+    return rand() / (RAND_MAX + 1.0);
+}
+
+// Byte as seen by a receiver, with bit errors on the 10 bits of the character
+static int corrupt(int c, double ber) {
+    int bit;
+
+    if (ber <= 0) return c;
+    for (bit = 0; bit < 10; bit++) {
+        if (uniform() < ber) {
+            if (bit == 0 || bit == 9) return -1;  // start/stop bit: framing error, byte lost
+            c ^= 1 << (bit - 1);
+        }
+    }
+    return c;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static struct result simulate(int n, long baud, double ber, double seconds) {
+    struct result r;
+    double byte_us = 10e6 / baud;
+    double now_us = 0, next_ms = 1000;
+    double latency_sum = 0;
+    uint8_t data[LINK_MAX_PAYLOAD], src;
+    int i, j, len, talking;
+    int line;
+
+    memset(&r, 0, sizeof r);
+    memset(nodes, 0, sizeof nodes);
+    for (i = 0; i < n; i++) {
+        link_init(&nodes[i].link, &nodes[i].io, (uint8_t)(i + 1));
+        nodes[i].tx_byte = -1;
+        if (n == 2) nodes[i].link.quiet_ms = 0;  // full duplex: no carrier sense
+    }
+
+    while (now_us < seconds * 1e6) {
+        // Applications: offer traffic, collect deliveries
+        for (i = 0; i < n; i++) {
+            struct node *nd = &nodes[i];
+            int dst = (i + 1) % n;
+
+            if (!nd->has_pending) {
+                put32(nd->pending, (uint32_t)now_us);
+                put32(nd->pending + 4, nd->sent_count++);
+                nd->has_pending = 1;
+            }
+            if (link_send(&nd->link, (uint8_t)(dst + 1), nd->pending, LINK_MAX_PAYLOAD)) nd->has_pending = 0;
+
+            while ((len = link_recv(&nd->link, &src, data)) >= 0) {
+                uint32_t count = get32(data + 4);
+                j = src - 1;
+                if (len != LINK_MAX_PAYLOAD || j < 0 || j >= n) continue;
+                if (count < nd->next_count[j]) {
+                    uint32_t back = nd->next_count[j] - 1 - count;
+                    if (back >= 32 || (nd->seen[j] & (1ul << back))) {
+                        r.duplicates++;
+                        continue;
+                    }
+                    nd->seen[j] |= 1ul << back;
+                    r.reordered++;  // a retransmission overtaken by newer frames
+                } else {
+                    uint32_t ahead = count + 1 - nd->next_count[j];
+                    nd->seen[j] = ahead >= 32 ? 1 : (nd->seen[j] << ahead) | 1;
+                    nd->next_count[j] = count + 1;
+                }
+                double lat = (now_us - get32(data)) / 1000.0;
+                latency_sum += lat;
+                if (lat > r.latency_max_ms) r.latency_max_ms = lat;
+                r.delivered++;
+            }
+            link_poll(&nd->link);
+        }
+
+        // UARTs: each enabled transmitter puts one byte on the line
+        talking = 0;
+        line = -1;
+        for (i = 0; i < n; i++) {
+            struct node *nd = &nodes[i];
+            nd->tx_byte = -1;
+            if (nd->txie) {
+                nd->tx_byte = link_tx_next(&nd->io);
+                if (nd->tx_byte < 0) nd->txie = 0;
+                else {
+                    talking++;
+                    line = nd->tx_byte;
+                }
+            }
+        }
+
+        for (i = 0; i < n; i++) {
+            if (n == 2) {  // point to point: each node hears only the other
+                int c = nodes[1 - i].tx_byte;
+                if (c >= 0 && (c = corrupt(c, ber)) >= 0) link_rx_byte(&nodes[i].io, (uint8_t)c);
+            } else if (talking && nodes[i].tx_byte < 0) {  // bus: everyone but the talkers
+                int c = talking > 1 ? rand() & 0xFF : corrupt(line, ber);
+                if (c >= 0) link_rx_byte(&nodes[i].io, (uint8_t)c);
+            }
+        }
+
+        now_us += byte_us;
+        while (now_us >= next_ms) {
+            for (i = 0; i < n; i++) link_tick(&nodes[i].link, 1);
+            next_ms += 1000;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        r.crc_errors += nodes[i].link.crc_errors;
+        r.retransmits += nodes[i].link.retransmits;
+        r.failures += nodes[i].link.failures;
+    }
+    r.goodput = r.delivered * (double)LINK_MAX_PAYLOAD / seconds;
+    r.latency_mean_ms = r.delivered ? latency_sum / r.delivered : 0;
+    return r;
+}
+
+static void print_header(void) {
+    printf("%5s %7s %8s %10s %8s %8s %9s %5s %5s %7s %7s %6s\n", "nodes", "baud", "ber", "goodput", "lat_ms", "max_ms",
+           "delivered", "dup", "reord", "crc_err", "retx", "failed");
+}
+
+static void print_result(int n, long baud, double ber, const struct result *r) {
+    printf("%5d %7ld %8.0e %8.0f/s %8.1f %8.1f %9lu %5lu %5lu %7lu %7lu %6lu\n", n, baud, ber, r->goodput,
+           r->latency_mean_ms, r->latency_max_ms, r->delivered, r->duplicates, r->reordered, r->crc_errors,
+           r->retransmits, r->failures);
+}
+
+int main(int argc, char **argv) {
+    static const long bauds[] = {19200, 38400, 57600, 115200};
+    static const double bers[] = {0, 1e-5, 1e-4, 1e-3};
+    int n = 2, i, j, sweep = 0;
+    long baud = 19200;
+    double ber = 0, seconds = 30;
+    struct result r;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) n = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-b") && i + 1 < argc) baud = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-e") && i + 1 < argc) ber = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc) seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc) srand((unsigned)atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--sweep")) sweep = 1;
+        else {
+            fprintf(stderr, "usage: %s [-n nodes] [-b baud] [-e bit_error_rate] [-t seconds] [-s seed] [--sweep]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (n < 2 || n > MAX_NODES) {
+        fprintf(stderr, "nodes must be 2..%d\n", MAX_NODES);
+        return 1;
+    }
+
+    print_header();
+    if (!sweep) {
+        r = simulate(n, baud, ber, seconds);
+        print_result(n, baud, ber, &r);
+        return 0;
+    }
+    for (i = 0; i < (int)(sizeof bauds / sizeof bauds[0]); i++) {
+        for (j = 0; j < (int)(sizeof bers / sizeof bers[0]); j++) {
+            r = simulate(n, bauds[i], bers[j], seconds);
+            print_result(n, bauds[i], bers[j], &r);
+        }
+    }
+    return 0;
+}
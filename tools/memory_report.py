@@ -0,0 +1,306 @@
+#!/usr/bin/env python3
+"""RAM / flash / stack budget report for every activity.
+
+Compiles each activity folder ("1 - sensor read", ...) with XC8 for the
+PIC16F886, then parses the linker map file and the assembler listing and
+writes one JSON report with:
+
+  - per module (object file): flash words, RAM bytes, EEPROM bytes
+  - per symbol: address, space and size (size estimated from the distance to
+    the next symbol of the same psect)
+  - call depth of main() and of the ISR, and the resulting worst case use of
+    the 8-level hardware stack (the ISR can interrupt main at its deepest call)
+  - the RAM objects larger than one bank: the PIC16F886 has no linear data
+    memory, so an object must fit in one bank of at most 96 bytes
+
+The JSON is sorted and stable so two reports can be diffed between commits:
+
+    tools/memory_report.py -o before.json
+    git checkout <other>
+    tools/memory_report.py -o after.json
+    tools/memory_report.py --diff before.json after.json
+
+The sources of each activity are its main.c plus the .c file of every header
+it includes, and of the headers those include in turn, taken from the
+activity's ./libraries folder or else from the top-level libraries folder.
+The third-party libraries are not distributed, so they must be copied into
+one of the two first.
+
+Only XC8 (xc8-cc, v2.x) is supported: the programs use XC8 extensions
+(__interrupt(), __EEPROM_DATA, EEPROM_READ) that SDCC's pic14 port does not
+accept.
+"""
+
+import argparse
+import glob
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+
+CHIP = "16F886"
+RAM_BYTES = 368
+BANK_BYTES = 96  # largest general-purpose bank (bank 1 has 80)
+FLASH_WORDS = 8192
+EEPROM_BYTES = 256
+HW_STACK_LEVELS = 8
+
+# Space numbers used by the XC8 linker for mid-range PICs
+SPACE_CODE = 0
+SPACE_DATA = 1
+SPACE_EEPROM = 3
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def find_compiler():
+    for name in ("xc8-cc", "xc8"):
+        path = shutil.which(name)
+        if path:
+            return path
+    return None
+
+
+def activities():
+    for path in sorted(glob.glob(os.path.join(ROOT, "[0-9]*"))):
+        if os.path.isfile(os.path.join(path, "main.c")):
+            yield path
+
+
+# '#include "./libraries/ttc.h"' in a program, '#include "ttc.h"' in a library
+INCLUDE_LINE = re.compile(r'^\s*#\s*include\s+"(?:\./libraries/)?(\w+)\.h"', re.M)
+
+
+def library_files(activity):
+    """Library name -> (header, source), the activity's own copy first."""
+    files = {}
+    for folder in (os.path.join(ROOT, "libraries"), os.path.join(activity, "libraries")):
+        for header in glob.glob(os.path.join(folder, "*.h")):
+            name = os.path.splitext(os.path.basename(header))[0]
+            source = os.path.splitext(header)[0] + ".c"
+            files[name] = (header, source if os.path.isfile(source) else None)
+    return files
+
+
+def sources(activity):
+    libraries = library_files(activity)
+    main = os.path.join(activity, "main.c")
+    used = set()
+    pending = [main]
+    while pending:
+        with open(pending.pop(), errors="replace") as f:
+            text = f.read()
+        for name in INCLUDE_LINE.findall(text):
+            if name in used or name not in libraries:
+                continue
+            used.add(name)
+            pending += [path for path in libraries[name] if path]
+    return [main] + sorted(libraries[name][1] for name in used if libraries[name][1])
+
+
+def compile_activity(cc, activity, workdir):
+    out = os.path.join(workdir, "main.elf")
+    mapfile = os.path.join(workdir, "main.map")
+    cmd = [cc, "-mcpu=" + CHIP, "-O2", "-Wl,-Map=" + mapfile, "-Wa,-a", "-o", out]
+    cmd += ["-I", ROOT, "-I", os.path.join(activity, "libraries")]  # "./libraries/x.h", and the copies
+    cmd += sources(activity)
+    proc = subprocess.run(cmd, cwd=activity, capture_output=True, text=True)
+    if proc.returncode != 0:
+        return None, proc.stderr.strip()
+    listing = glob.glob(os.path.join(workdir, "*.lst")) + glob.glob(os.path.join(activity, "*.lst"))
+    return (mapfile, listing[0] if listing else None), None
+
+
+# Map file ------------------------------------------------------------------
+
+# "                text1      7E9      7E9       17      FD2       0"
+PSECT_LINE = re.compile(r"^\s+(\w+)\s+([0-9A-F]+)\s+([0-9A-F]+)\s+([0-9A-F]+)\s+([0-9A-F]+)\s+(\d+)")
+OBJECT_LINE = re.compile(r"^(\S+\.(?:o|p1|obj))\s*$")
+# "_counter1                 bssCOMMON         0070"
+SYMBOL_LINE = re.compile(r"^\s*(_\w+)\s+(\w+)\s+([0-9A-F]+)\s*$")
+
+
+def parse_map(path):
+    modules = {}
+    symbols = []
+    psect_space = {}
+    section = None
+    module = None
+    with open(path, errors="replace") as f:
+        for line in f:
+            if line.startswith("Name") and "Link" in line and "Length" in line:
+                section = "objects"
+                continue
+            if line.startswith("TOTAL"):
+                section = None
+            if line.startswith("Symbol Table"):
+                section = "symbols"
+                continue
+            if section == "objects":
+                m = OBJECT_LINE.match(line.strip())
+                if m:
+                    module = os.path.splitext(os.path.basename(m.group(1)))[0]
+                    modules.setdefault(module, {"flash_words": 0, "ram_bytes": 0, "eeprom_bytes": 0})
+                    continue
+                m = PSECT_LINE.match(line)
+                if m and module:
+                    psect, length, space = m.group(1), int(m.group(4), 16), int(m.group(6))
+                    psect_space[psect] = space
+                    key = {SPACE_CODE: "flash_words", SPACE_DATA: "ram_bytes", SPACE_EEPROM: "eeprom_bytes"}.get(space)
+                    if key:
+                        modules[module][key] += length
+            elif section == "symbols":
+                for m in SYMBOL_LINE.finditer(line):
+                    symbols.append((m.group(1), m.group(2), int(m.group(3), 16)))
+
+    # Estimate each symbol's size from the next symbol in the same psect
+    by_psect = {}
+    for name, psect, addr in symbols:
+        by_psect.setdefault(psect, []).append((addr, name))
+    sized = {}
+    for psect, entries in by_psect.items():
+        entries.sort()
+        for i, (addr, name) in enumerate(entries):
+            size = entries[i + 1][0] - addr if i + 1 < len(entries) else None
+            space = psect_space.get(psect)
+            sized[name] = {
+                "psect": psect,
+                "address": addr,
+                "space": {SPACE_CODE: "flash", SPACE_DATA: "ram", SPACE_EEPROM: "eeprom"}.get(space, "other"),
+                "size": size,
+            }
+    return modules, sized
+
+
+# Listing / call graph ----------------------------------------------------
+
+# XC8 prints "Call Graph Tables" with one line per function: " (2) _sensorNear_read ..."
+CALL_LINE = re.compile(r"^\s*\((\d+)\)\s+(_\w+)")
+
+
+def parse_call_graph(path):
+    depth = {}
+    root = None
+    if not path:
+        return None
+    in_graph = False
+    with open(path, errors="replace") as f:
+        for line in f:
+            if "Call Graph Tables" in line:
+                in_graph = True
+                continue
+            if in_graph and line.startswith(" Call Graph Graphs"):
+                break
+            if not in_graph:
+                continue
+            m = CALL_LINE.match(line)
+            if not m:
+                continue
+            level, name = int(m.group(1)), m.group(2)
+            if level == 0:
+                root = name
+                depth.setdefault(root, 0)
+            elif root:
+                depth[root] = max(depth[root], level)
+    if not depth:
+        return None
+    main = depth.get("_main", 0)
+    isr = max((d for name, d in depth.items() if name != "_main"), default=0)
+    # main's calls, then the ISR's return address, then the ISR's own calls
+    worst = main + 1 + isr
+    return {
+        "main_depth": main,
+        "isr_depth": isr,
+        "worst_case_levels": worst,
+        "hardware_levels": HW_STACK_LEVELS,
+        "overflow": worst > HW_STACK_LEVELS,
+    }
+
+
+# Report ----------------------------------------------------------------
+
+
+def build_report(cc):
+    report = {"chip": CHIP, "limits": {"ram_bytes": RAM_BYTES, "flash_words": FLASH_WORDS, "eeprom_bytes": EEPROM_BYTES}}
+    report["activities"] = {}
+    for activity in activities():
+        name = os.path.basename(activity)
+        with tempfile.TemporaryDirectory() as workdir:
+            outputs, error = compile_activity(cc, activity, workdir)
+            if error is not None:
+                report["activities"][name] = {"error": error.splitlines()[-1] if error else "compile failed"}
+                continue
+            mapfile, listing = outputs
+            modules, symbols = parse_map(mapfile)
+            totals = {key: sum(m[key] for m in modules.values()) for key in ("flash_words", "ram_bytes", "eeprom_bytes")}
+            over_bank = sorted(
+                symbol for symbol, info in symbols.items() if info["space"] == "ram" and (info["size"] or 0) > BANK_BYTES
+            )
+            for symbol in over_bank:
+                print("memory_report: %s: %s takes %d bytes, more than a bank" % (name, symbol, symbols[symbol]["size"]),
+                      file=sys.stderr)
+            report["activities"][name] = {
+                "totals": totals,
+                "modules": modules,
+                "symbols": symbols,
+                "over_bank": over_bank,
+                "stack": parse_call_graph(listing),
+            }
+    return report
+
+
+def flatten(report):
+    rows = {}
+    for name, act in report.get("activities", {}).items():
+        for key, value in act.get("totals", {}).items():
+            rows[(name, "total", key)] = value
+        for module, sizes in act.get("modules", {}).items():
+            for key, value in sizes.items():
+                rows[(name, module, key)] = value
+        rows[(name, "total", "over_bank")] = len(act.get("over_bank", []))
+        stack = act.get("stack") or {}
+        if "worst_case_levels" in stack:
+            rows[(name, "stack", "levels")] = stack["worst_case_levels"]
+    return rows
+
+
+def diff(old_path, new_path):
+    with open(old_path) as f:
+        old = flatten(json.load(f))
+    with open(new_path) as f:
+        new = flatten(json.load(f))
+    for key in sorted(set(old) | set(new)):
+        a, b = old.get(key, 0), new.get(key, 0)
+        if a != b:
+            print("%-28s %-16s %-13s %6d -> %6d (%+d)" % (key + (a, b, b - a)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-o", "--output", help="write the JSON report here instead of stdout")
+    parser.add_argument("--diff", nargs=2, metavar=("OLD", "NEW"), help="compare two reports")
+    args = parser.parse_args()
+
+    if args.diff:
+        diff(*args.diff)
+        return 0
+
+    cc = find_compiler()
+    if not cc:
+        print("memory_report: xc8-cc not found in PATH", file=sys.stderr)
+        return 1
+
+    text = json.dumps(build_report(cc), indent=2, sort_keys=True)
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text + "\n")
+    else:
+        print(text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
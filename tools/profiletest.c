@@ -0,0 +1,130 @@
+/*
+
+Host test of the wheel speed profiles (libraries/profile.h)
+
+Runs the real profile.c tick by tick and checks, for each move, that the
+setpoint goes from where it was to the target without passing it, without
+turning back (unless it was speeding away from it), and stays there once
+reached:
+
+    s-curve      0 to 550, back to 0, to -300 and across 0 to +300, with
+                 the autonomous task's limits (1500, 2500, 15000)
+    trapezoid    the same with no jerk limit
+    mid-ramp     a target set just ahead of the speed while the wheel is
+                 still accelerating hard, so it is reached with the
+                 acceleration far above one jerk step; and just behind it,
+                 closer than one step once the wheel has come back
+    stop         profile_stop_distance() against the distance the ticks
+                 actually cover once the target is 0
+
+It prints the failed checks and a count, and exits with 1 if any failed.
+
+Build and run from the repository root:
+    cc -O2 -I libraries tools/profiletest.c libraries/profile.c -o profiletest
+    ./profiletest
+
+*/
+
+#include <stdio.h>
+
+#include "profile.h"
+
+#define MAX_TICKS 400
+#define SETTLE_TICKS 20  // at the target this long counts as reached
+
+static int checks, failed;
+
+static void check_eq(const char *what, long value, long expected) {
+    checks++;
+    if (value != expected) {
+        failed++;
+        printf("FAIL %s: %ld, expected %ld\n", what, value, expected);
+    }
+}
+
+#define CHECK_EQ(what, value, expected) check_eq(what, (long)(value), (long)(expected))
+
+// Sets the target of channel 1 and steps until it has stayed there for
+// SETTLE_TICKS; checks the setpoint never passes it and, unless the wheel is
+// still accelerating away from it, never turns back
+static void move(const char *what, int16_t target, char monotonic) {
+    int16_t start = profile_get(1), last = start, now;
+    int tick, settled = 0, passed = 0, back = 0;
+    int up = target > start;
+
+    profile_set(1, target);
+    for (tick = 0; tick < MAX_TICKS && settled < SETTLE_TICKS; tick++) {
+        profile_step();
+        now = profile_get(1);
+        if (up ? now > target : now < target) passed++;
+        if (up ? now < last : now > last) back++;
+        settled = now == target ? settled + 1 : 0;
+        last = now;
+    }
+    printf("%-32s %5d to %5d in %3d ticks\n", what, start, target, tick - settled);
+    CHECK_EQ(what, settled, SETTLE_TICKS);
+    CHECK_EQ("  ticks past the target", passed, 0);
+    if (monotonic) CHECK_EQ("  ticks turning back", back, 0);
+}
+
+static void test_moves(int16_t jerk) {
+    profile_init();
+    profile_limits(1500, 2500, jerk);
+    move(jerk ? "s-curve up" : "trapezoid up", 550, 1);
+    move(jerk ? "s-curve down" : "trapezoid down", 0, 1);
+    move(jerk ? "s-curve backwards" : "trapezoid backwards", -300, 1);
+    move(jerk ? "s-curve across 0" : "trapezoid across 0", 300, 1);
+}
+
+// Accelerating at the limit, the jerk limit lets the acceleration fall by a
+// step per tick only: with 3000 it is a dozen steps when the target is
+// reached. Behind the speed, the wheel goes on speeding up for a few
+// ticks before it can come back.
+static void test_mid_ramp(int16_t jerk, int ramp_ticks) {
+    int16_t gap;
+    int tick;
+
+    for (gap = 1; gap <= 40; gap += 13) {
+        profile_init();
+        profile_limits(1500, 2500, jerk);
+        profile_set(1, 1000);
+        for (tick = 0; tick < ramp_ticks; tick++) profile_step();
+        move("mid-ramp, target just ahead", (int16_t)(profile_get(1) + gap), 1);
+        profile_set(1, 1000);
+        for (tick = 0; tick < ramp_ticks; tick++) profile_step();
+        move("mid-ramp, target just behind", (int16_t)(profile_get(1) - gap), 0);
+    }
+}
+
+static void test_stop(void) {
+    int32_t predicted, sum = 0;
+    int tick;
+
+    profile_init();
+    profile_limits(1500, 2500, 15000);
+    profile_set(1, 700);
+    for (tick = 0; tick < 12; tick++) profile_step();  // still ramping
+    predicted = profile_stop_distance(1);
+    profile_set(1, 0);
+    for (tick = 0; tick < MAX_TICKS && profile_get(1) != 0; tick++) {
+        profile_step();
+        sum += profile_get(1);
+    }
+    // profile_get() drops the fraction the prediction keeps: within a unit a tick
+    checks++;
+    if (sum * PROFILE_DT_MS / 1000 > predicted || (sum + tick) * PROFILE_DT_MS / 1000 + 1 < predicted) {
+        failed++;
+        printf("FAIL stop distance: %ld predicted, %ld covered\n", (long)predicted,
+               (long)(sum * PROFILE_DT_MS / 1000));
+    }
+}
+
+int main(void) {
+    test_moves(15000);
+    test_moves(0);
+    test_mid_ramp(15000, 6);
+    test_mid_ramp(3000, 20);
+    test_stop();
+    printf("profiletest: %d checks, %d failed\n", checks, failed);
+    return failed != 0;
+}
@@ -0,0 +1,703 @@
+/*
+
+Batch simulation of the autonomous task over a library of tracks
+
+Sweeps the autonomous task's parameters (top speed, inner-wheel speed in
+turns, obstacle clearance, ramp limits, curve anticipation, pivots, learned
+speed plan) over every combination in the given ranges and runs each
+combination on every track, all cores at once. The
+control logic is the firmware's own: libraries/follow.c picks the wheel
+speeds from the line sensor, libraries/curve.c estimates the tape's
+curvature from the sensor's change times, libraries/ttc.c brakes for
+obstacles, libraries/lapmap.c plans the speed from the first lap and
+libraries/profile.c ramps the wheels, called in the same order
+and at the same rates as in "4 - autonomous task/main.c". Around them is a simple model
+of the cart: a differential drive with a motor dead band and lag, three line
+sensors ahead of the axle and the GP2D120 proximity sensor with noise.
+
+Each run starts at rest at the start of the track and ends after one lap,
+or --laps of them, or fails after the time limit. It measures:
+
+    lap      seconds for the last lap, including waiting at obstacles
+    clear    smallest gap between the cart's front and an obstacle, mm
+             (0 = hit it)
+    offline  seconds with the line lost (sensor reading 000 or 101)
+
+For each combination the laps and the off-line times are added over the
+tracks and the clearance is the smallest of all. The output is the set of
+combinations that no other one beats on all three at once (the Pareto
+front), sorted by lap time, and the two-way fronts of lap time against
+clearance and against off-line time.
+
+The firmware modules keep their state in static variables, as on the PIC,
+so the runs are spread over processes rather than threads. The runs are
+split evenly between the workers; a worker that runs out steals half of
+the largest share left, so a few slow runs do not leave the other cores
+idle.
+
+Track files are turtle paths, one command per line, lengths in mm, angles
+in degrees, positive to the left; see tools/tracks/:
+
+    width 19                  line width
+    straight 600
+    arc 250 180               radius, angle
+    obstacle 900 0 40 3       at 900 mm along the line, 0 mm to its left,
+                              radius 40 mm, taken away 3 s after the cart stops
+
+Build and run from the repository root:
+    cc -O2 -I libraries tools/tracksim.c libraries/follow.c libraries/curve.c libraries/ttc.c libraries/profile.c \
+       libraries/lapmap.c libraries/odometry.c libraries/trig.c -lm -o tracksim
+    ./tracksim tools/tracks/oval.track tools/tracks/circle.track tools/tracks/circuit.track
+    ./tracksim --duty 300:1023:25 --turn 0:90:5 --clear 30:150:10 --csv all.csv tools/tracks/circuit.track
+
+*/
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "curve.h"
+#include "follow.h"
+#include "lapmap.h"
+#include "odometry.h"
+#include "profile.h"
+#include "ttc.h"
+
+// Must match "4 - autonomous task/main.c"
+#define TICK_MS 5
+#define CONTROL_DT_MS 40
+#define WARMUP_MS 40  // POWER_WARMUP_MS
+
+// Cart model, estimates for the lab cart
+#define WHEEL_BASE_MM ODO_TRACK_MM
+#define SENSOR_AHEAD_MM CURVE_AHEAD_MM  // line sensors ahead of the axle
+#define SENSOR_PITCH_MM CURVE_PITCH_MM  // between neighbouring line sensors
+#define FRONT_MM 75.0          // front of the cart and the proximity sensor, ahead of the axle
+#define MOTOR_DEAD_DUTY 60     // no motion below this duty cycle
+#define MOTOR_TAU_MS 60.0      // wheel speed lag
+#define NEAR_NOISE 3.0         // proximity reading noise, ADC counts (1 sigma)
+#define NEAR_BEAM_DEG 4.0      // half-width of the proximity beam
+
+#define STEP_MM 5.0  // track polyline resolution
+#define MAX_TRACKS 32
+#define MAX_OBSTACLES 8
+#define MAX_WORKERS 256
+#define STOPPED_MMPS 10.0
+
+struct obstacle {
+    double x, y, r;
+    double hold_s;  // removed this long after the cart stops in front of it
+};
+
+struct track {
+    const char *name;
+    double *x, *y;  // polyline of the line, STEP_MM apart, closed
+    int n;
+    double length;
+    double width;
+    struct obstacle obstacles[MAX_OBSTACLES];
+    int n_obstacles;
+};
+
+struct params {
+    int duty, turn, clear, accel, decel, jerk, antic, pivot, grip;
+};
+
+struct result {
+    float lap_s;  // of the last lap; < 0: not all laps within the time limit
+    float clear_mm;
+    float offline_s;
+};
+
+struct range {
+    int first, last, step;
+};
+
+static struct track tracks[MAX_TRACKS];
+static int n_tracks;
+static double limit_s = 60;
+static int laps = 1;
+static unsigned long seed = 1;
+
+// Pool shared by the worker processes: per worker, the runs left, packed
+// as first (low 32 bits) and end (high 32 bits)
+struct pool {
+    _Atomic uint64_t share[MAX_WORKERS];
+    atomic_long done;
+    struct result results[];
+};
+
+static uint64_t pack(uint32_t first, uint32_t end) {
+    return (uint64_t)end << 32 | first;
+}
+
+// Random numbers: xorshift64*, one stream per run so results do not depend
+// on which worker ran it
+static uint64_t rng;
+
+static double uniform(void) {
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    return ((rng * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double gauss(void) {
+    return sqrt(-2 * log(1 - uniform())) * cos(2 * M_PI * uniform());
+}
+
+// Track files
+
+static void add_point(struct track *t, double x, double y) {
+    t->x = realloc(t->x, (t->n + 1) * sizeof *t->x);
+    t->y = realloc(t->y, (t->n + 1) * sizeof *t->y);
+    t->x[t->n] = x;
+    t->y[t->n] = y;
+    t->n++;
+}
+
+static int load_track(struct track *t, const char *path) {
+    FILE *f = fopen(path, "r");
+    char line[256], cmd[32];
+    double x = 0, y = 0, th = 0, a, b, c, d;
+    struct {
+        double at, left, r, hold;
+    } obs[MAX_OBSTACLES];
+    int i, k, steps, n_obs = 0, line_no = 0;
+
+    if (!f) {
+        perror(path);
+        return 0;
+    }
+    memset(t, 0, sizeof *t);
+    t->name = path;
+    t->width = 19;
+    add_point(t, 0, 0);
+
+    while (fgets(line, sizeof line, f)) {
+        char *hash = strchr(line, '#');
+        line_no++;
+        if (hash) *hash = 0;
+        k = sscanf(line, "%31s %lf %lf %lf %lf", cmd, &a, &b, &c, &d);
+        if (k <= 0) continue;
+        if (!strcmp(cmd, "width") && k == 2) t->width = a;
+        else if (!strcmp(cmd, "straight") && k == 2) {
+            steps = (int)ceil(a / STEP_MM);
+            for (i = 1; i <= steps; i++) add_point(t, x + cos(th) * a * i / steps, y + sin(th) * a * i / steps);
+            x += cos(th) * a;
+            y += sin(th) * a;
+        } else if (!strcmp(cmd, "arc") && k == 3 && a > 0) {
+            double turn = b * M_PI / 180, side = turn > 0 ? 1 : -1;
+            double cx = x - sin(th) * a * side, cy = y + cos(th) * a * side;
+            steps = (int)ceil(fabs(turn) * a / STEP_MM);
+            for (i = 1; i <= steps; i++) {
+                double h = th + turn * i / steps;
+                add_point(t, cx + sin(h) * a * side, cy - cos(h) * a * side);
+            }
+            th += turn;
+            x = t->x[t->n - 1];
+            y = t->y[t->n - 1];
+        } else if (!strcmp(cmd, "obstacle") && k == 5 && n_obs < MAX_OBSTACLES) {
+            obs[n_obs].at = a;
+            obs[n_obs].left = b;
+            obs[n_obs].r = c;
+            obs[n_obs].hold = d;
+            n_obs++;
+        } else {
+            fprintf(stderr, "%s:%d: cannot read \"%s\"\n", path, line_no, cmd);
+            fclose(f);
+            return 0;
+        }
+    }
+    fclose(f);
+
+    if (t->n < 3 || hypot(x, y) > 2 * STEP_MM) {
+        fprintf(stderr, "%s: the path does not end where it starts (%.0f, %.0f)\n", path, x, y);
+        return 0;
+    }
+    t->n--;  // the last point is the first one
+    for (i = 0; i < t->n; i++) t->length += hypot(t->x[(i + 1) % t->n] - t->x[i], t->y[(i + 1) % t->n] - t->y[i]);
+
+    // Obstacles: from the distance along the line to a position
+    for (k = 0; k < n_obs; k++) {
+        double s = 0, seg = 1;
+        for (i = 0; i < t->n; i++) {
+            int j = (i + 1) % t->n;
+            seg = hypot(t->x[j] - t->x[i], t->y[j] - t->y[i]);
+            if (s + seg >= fmod(obs[k].at, t->length)) break;
+            s += seg;
+        }
+        {
+            int j = (i + 1) % t->n;
+            double dx = (t->x[j] - t->x[i]) / seg, dy = (t->y[j] - t->y[i]) / seg, u = fmod(obs[k].at, t->length) - s;
+            struct obstacle *o = &t->obstacles[t->n_obstacles++];
+            o->x = t->x[i] + dx * u - dy * obs[k].left;
+            o->y = t->y[i] + dy * u + dx * obs[k].left;
+            o->r = obs[k].r;
+            o->hold_s = obs[k].hold;
+        }
+    }
+    return 1;
+}
+
+// Distance from (px, py) to the segment i..i+1, and the fraction along it
+static double segment_distance(const struct track *t, int i, double px, double py, double *frac) {
+    int j = (i + 1) % t->n;
+    double dx = t->x[j] - t->x[i], dy = t->y[j] - t->y[i];
+    double u = ((px - t->x[i]) * dx + (py - t->y[i]) * dy) / (dx * dx + dy * dy);
+
+    if (u < 0) u = 0;
+    if (u > 1) u = 1;
+    *frac = u;
+    return hypot(t->x[i] + u * dx - px, t->y[i] + u * dy - py);
+}
+
+// Nearest segment to (px, py): walks from *index while the neighbours are
+// closer, which finds the right one for a point near the line; searches the
+// whole line if global is set
+static double nearest(const struct track *t, int *index, char global, double px, double py) {
+    double best, d, frac;
+    int i, step;
+
+    if (global) {
+        best = 1e30;
+        for (i = 0; i < t->n; i++) {
+            d = segment_distance(t, i, px, py, &frac);
+            if (d < best) {
+                best = d;
+                *index = i;
+            }
+        }
+        return best;
+    }
+    best = segment_distance(t, *index, px, py, &frac);
+    for (step = 1; step >= -1; step -= 2) {
+        for (;;) {
+            i = (*index + step + t->n) % t->n;
+            d = segment_distance(t, i, px, py, &frac);
+            if (d >= best) break;
+            best = d;
+            *index = i;
+        }
+    }
+    return best;
+}
+
+// Cart model
+
+// GP2D120: inverse of the calibration in ttc.h, R = 23256 / (V + 14) - 2
+static int near_read(const struct track *t, const char *present, double x, double y, double th) {
+    double range = 1e9, v;
+    int k, ray;
+
+    for (ray = -1; ray <= 1; ray++) {
+        double h = th + ray * NEAR_BEAM_DEG * M_PI / 180, dx = cos(h), dy = sin(h);
+        for (k = 0; k < t->n_obstacles; k++) {
+            const struct obstacle *o = &t->obstacles[k];
+            double ox = o->x - x, oy = o->y - y;
+            double along = ox * dx + oy * dy, across2 = ox * ox + oy * oy - along * along;
+            if (!present[k] || across2 > o->r * o->r) continue;
+            along -= sqrt(o->r * o->r - across2);
+            if (along >= 0 && along < range) range = along;
+        }
+    }
+    if (range < 30) range = 30;  // closer, the real sensor folds back; not modelled
+    if (range > 400) range = 400;
+    v = TTC_CAL_M / (range + TTC_CAL_K) - TTC_CAL_B + gauss() * NEAR_NOISE;
+    return v < 0 ? 0 : v > 1023 ? 1023 : (int)v;
+}
+
+static uint8_t line_read(const struct track *t, int index, double x, double y, double th) {
+    uint8_t bits = 0;
+    int i, k;
+
+    for (i = 0; i < 3; i++) {  // bit 2 = left sensor
+        double side = (1 - i) * SENSOR_PITCH_MM;
+        double sx = x + cos(th) * SENSOR_AHEAD_MM - sin(th) * side;
+        double sy = y + sin(th) * SENSOR_AHEAD_MM + cos(th) * side;
+        k = (index + (int)(SENSOR_AHEAD_MM * t->n / t->length)) % t->n;
+        if (nearest(t, &k, 0, sx, sy) <= t->width / 2) bits |= 4 >> i;
+    }
+    return bits;
+}
+
+static double wheel_target(int duty) {
+    if (duty < 0) return -wheel_target(-duty);  // backwards, through drive.h
+    if (duty <= MOTOR_DEAD_DUTY) return 0;
+    return (double)(duty - MOTOR_DEAD_DUTY) * TTC_MMPS_FULL / (TTC_DUTY_FULL - MOTOR_DEAD_DUTY);
+}
+
+static struct result run(const struct track *t, const struct params *p) {
+    struct result r = {-1, 1e9f, 0};
+    char present[MAX_OBSTACLES];
+    double stopped_s[MAX_OBSTACLES];
+    double x = t->x[0], y = t->y[0], th = atan2(t->y[1] - t->y[0], t->x[1] - t->x[0]);
+    double v_right = 0, v_left = 0, progress = 0, position = 0, dt = TICK_MS / 1000.0, lag = TICK_MS / MOTOR_TAU_MS, s;
+    double enc_right = 0, enc_left = 0, lap_start_s = 0;  // wheel travel, mm
+    int duty_right = 0, duty_left = 0, index = 0, k, tick, adc, lap = 0;
+    long count_right = 0, count_left = 0, now_right, now_left;
+    int16_t mmps_right, mmps_left;
+    char lost = 0;
+    double frac;
+
+    for (k = 0; k < t->n_obstacles; k++) {
+        present[k] = 1;
+        stopped_s[k] = 0;
+    }
+
+    // As at the key press that starts the task
+    profile_init();
+    profile_limits((int16_t)p->accel, (int16_t)p->decel, (int16_t)p->jerk);
+    ttc_init();
+    ttc_clearance((int16_t)p->clear);
+    curve_init();
+    follow_init();
+    follow_pivot((uint8_t)p->pivot);
+    lapmap_limits((int16_t)p->grip, (int16_t)p->decel, TTC_MMPS_FULL);
+    lapmap_start();
+
+    for (tick = 0; tick * dt < limit_s; tick++) {
+        char warm = tick * TICK_MS >= WARMUP_MS;
+
+        // Control tick
+        if (tick % (CONTROL_DT_MS / TICK_MS) == 0) {
+            now_right = (long)floor(enc_right * 256 / ODO_MM_PER_PULSE_Q8);  // encoders
+            now_left = (long)floor(enc_left * 256 / ODO_MM_PER_PULSE_Q8);
+            mmps_right = (int16_t)((now_right - count_right) * ODO_MM_PER_PULSE_Q8 * (1000 / CONTROL_DT_MS) / 256);
+            mmps_left = (int16_t)((now_left - count_left) * ODO_MM_PER_PULSE_Q8 * (1000 / CONTROL_DT_MS) / 256);
+            if (warm) {
+                adc = near_read(t, present, x + cos(th) * FRONT_MM, y + sin(th) * FRONT_MM, th);
+                ttc_update((int16_t)adc, (int16_t)((mmps_right + mmps_left) / 2));
+            }
+            if (warm) {
+                curve_update(mmps_right, mmps_left);
+                follow_curvature((int16_t)((long)curve_curvature() * p->antic / 100));
+            }
+            lapmap_update((int16_t)(now_left - count_left), (int16_t)(now_right - count_right), lost);
+            count_right = now_right;
+            count_left = now_left;
+            profile_step();
+            duty_right = profile_get(1);
+            duty_left = profile_get(2);
+        }
+
+        // Timer 0 tick and main loop pass
+        if (warm) {
+            uint8_t line = line_read(t, index, x, y, th);
+            curve_sample(line, (uint8_t)tick);
+            lost = follow_step(line, lapmap_duty(ttc_duty_limit(p->duty)), (uint8_t)p->turn) == FOLLOW_LOST;
+            if (lost) r.offline_s += (float)dt;
+        }
+
+        // Cart
+        v_right += (wheel_target(duty_right) - v_right) * lag;
+        v_left += (wheel_target(duty_left) - v_left) * lag;
+        enc_right += v_right * dt;
+        enc_left += v_left * dt;
+        th += (v_right - v_left) / WHEEL_BASE_MM * dt;
+        x += cos(th) * (v_right + v_left) / 2 * dt;
+        y += sin(th) * (v_right + v_left) / 2 * dt;
+
+        // Progress along the line, from the nearest point; a global search
+        // every control tick while the cart is away from the line
+        if (nearest(t, &index, 0, x, y) > 3 * t->width && tick % (CONTROL_DT_MS / TICK_MS) == 0) {
+            nearest(t, &index, 1, x, y);
+        }
+        segment_distance(t, index, x, y, &frac);
+        s = index + frac - position;
+        if (s > t->n / 2) s -= t->n;
+        if (s < -t->n / 2) s += t->n;
+        progress += s * t->length / t->n;
+        position = index + frac;
+        if (progress >= (lap + 1) * t->length) {
+            r.lap_s = (float)((tick + 1) * dt - lap_start_s);
+            lap_start_s = (tick + 1) * dt;
+            if (++lap == laps) break;
+            r.lap_s = -1;
+        }
+
+        // Obstacles: clearance in front, removal after the cart waited
+        for (k = 0; k < t->n_obstacles; k++) {
+            const struct obstacle *o = &t->obstacles[k];
+            double fx = x + cos(th) * FRONT_MM, fy = y + sin(th) * FRONT_MM;
+            double gap = hypot(o->x - fx, o->y - fy) - o->r;
+            double ahead = (o->x - x) * cos(th) + (o->y - y) * sin(th);
+
+            if (!present[k] || ahead < FRONT_MM - o->r) continue;
+            if (gap < r.clear_mm) r.clear_mm = gap < 0 ? 0 : (float)gap;
+            if (gap <= 0) present[k] = 0;  // pushed aside
+            else if (gap < TTC_RANGE_MM && fabs(v_right + v_left) / 2 < STOPPED_MMPS) {
+                stopped_s[k] += dt;
+                if (stopped_s[k] >= o->hold_s) present[k] = 0;
+            }
+        }
+    }
+    return r;
+}
+
+// Pool
+
+static struct params combination(long i, const struct range *ranges) {
+    struct params p;
+    int *fields[9] = {&p.duty, &p.turn, &p.clear, &p.accel, &p.decel, &p.jerk, &p.antic, &p.pivot, &p.grip};
+    int k;
+
+    for (k = 8; k >= 0; k--) {
+        int count = (ranges[k].last - ranges[k].first) / ranges[k].step + 1;
+        *fields[k] = ranges[k].first + (int)(i % count) * ranges[k].step;
+        i /= count;
+    }
+    return p;
+}
+
+// Next run of this worker: its own share first, then half of the largest other share
+static long next_run(struct pool *pool, int self, int workers) {
+    uint64_t old, victim_old;
+    uint32_t first, end, half;
+    int k, victim;
+
+    for (;;) {
+        old = atomic_load(&pool->share[self]);
+        first = (uint32_t)old;
+        end = (uint32_t)(old >> 32);
+        if (first < end) {
+            if (atomic_compare_exchange_weak(&pool->share[self], &old, pack(first + 1, end))) return first;
+            continue;
+        }
+
+        victim = -1;
+        half = 0;
+        for (k = 0; k < workers; k++) {
+            uint64_t s = atomic_load(&pool->share[k]);
+            uint32_t left = (uint32_t)(s >> 32) - (uint32_t)s;
+            if (k != self && (uint32_t)s < (uint32_t)(s >> 32) && left >= 2 && left > half) {
+                half = left;
+                victim = k;
+            }
+        }
+        if (victim < 0) return -1;  // nothing left to share: the owners finish their last runs
+
+        victim_old = atomic_load(&pool->share[victim]);
+        first = (uint32_t)victim_old;
+        end = (uint32_t)(victim_old >> 32);
+        if (first >= end) continue;
+        half = (end - first) / 2;  // the victim keeps the first half
+        if (half == 0) continue;
+        if (atomic_compare_exchange_strong(&pool->share[victim], &victim_old, pack(first, end - half))) {
+            atomic_store(&pool->share[self], pack(end - half, end));
+        }
+    }
+}
+
+static void worker(struct pool *pool, int self, int workers, const struct range *ranges) {
+    struct params p;
+    long i;
+
+    while ((i = next_run(pool, self, workers)) >= 0) {
+        p = combination(i / n_tracks, ranges);
+        rng = (seed * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)i * 0xBF58476D1CE4E5B9ULL) ^ 1;
+        pool->results[i] = run(&tracks[i % n_tracks], &p);
+        atomic_fetch_add(&pool->done, 1);
+    }
+}
+
+// Fronts
+
+struct score {
+    long combination;
+    double lap_s, clear_mm, offline_s;
+};
+
+// Does a beat b: no worse on any of the objectives used, better on one
+static int dominates(const struct score *a, const struct score *b, int use_clear, int use_offline) {
+    int better = a->lap_s < b->lap_s;
+
+    if (a->lap_s > b->lap_s) return 0;
+    if (use_clear) {
+        if (a->clear_mm < b->clear_mm) return 0;
+        better |= a->clear_mm > b->clear_mm;
+    }
+    if (use_offline) {
+        if (a->offline_s > b->offline_s) return 0;
+        better |= a->offline_s < b->offline_s;
+    }
+    return better;
+}
+
+static int by_lap(const void *a, const void *b) {
+    const struct score *x = a, *y = b;
+    return x->lap_s < y->lap_s ? -1 : x->lap_s > y->lap_s;
+}
+
+static void print_front(const char *title, struct score *scores, long n, const struct range *ranges, int use_clear,
+                        int use_offline) {
+    long i, j;
+    struct params p;
+
+    printf("\n%s\n%7s %5s %5s %6s %6s %6s %5s %5s %5s %9s %8s %9s\n", title, "dutymax", "turn", "clear", "accel",
+           "decel", "jerk", "antic", "pivot", "grip", "lap_s", "clear_mm", "offline_s");
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < n; j++) {
+            if (j != i && dominates(&scores[j], &scores[i], use_clear, use_offline)) break;
+        }
+        if (j < n) continue;
+        // Equal scores: only the first one
+        for (j = 0; j < i; j++) {
+            if (scores[j].lap_s == scores[i].lap_s && (!use_clear || scores[j].clear_mm == scores[i].clear_mm) &&
+                (!use_offline || scores[j].offline_s == scores[i].offline_s))
+                break;
+        }
+        if (j < i) continue;
+        p = combination(scores[i].combination, ranges);
+        printf("%7d %5d %5d %6d %6d %6d %5d %5d %5d %9.2f ", p.duty, p.turn, p.clear, p.accel, p.decel, p.jerk,
+               p.antic, p.pivot, p.grip, scores[i].lap_s);
+        if (scores[i].clear_mm >= 1e9) printf("%8s", "-");  // no obstacles
+        else printf("%8.0f", scores[i].clear_mm);
+        printf(" %9.2f\n", scores[i].offline_s);
+    }
+}
+
+static int parse_range(const char *s, struct range *r) {
+    int n = sscanf(s, "%d:%d:%d", &r->first, &r->last, &r->step);
+
+    if (n == 1) {
+        r->last = r->first;
+        r->step = 1;
+    } else if (n == 2) {
+        r->step = 1;
+    } else if (n != 3) {
+        return 0;
+    }
+    return r->step > 0 && r->last >= r->first;
+}
+
+int main(int argc, char **argv) {
+    // Defaults: the firmware's deceleration, the rest swept
+    struct range ranges[9] = {{300, 900, 100}, {0, 90, 15},      {30, 150, 40}, {1500, 15000, 4500},
+                              {2500, 2500, 1},  {0, 30000, 15000}, {0, 100, 50}, {0, 50, 50}, {0, 0, 1}};
+    static const char *names[9] = {"--duty", "--turn",  "--clear", "--accel", "--decel",
+                                   "--jerk", "--antic", "--pivot", "--grip"};
+    int workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *csv = NULL;
+    long combinations = 1, runs, i, n_scores = 0;
+    struct pool *pool;
+    struct score *scores;
+    size_t size;
+    int k, w, t;
+
+    for (i = 1; i < argc; i++) {
+        for (k = 0; k < 9; k++) {
+            if (!strcmp(argv[i], names[k])) break;
+        }
+        if (k < 9 && i + 1 < argc) {
+            if (!parse_range(argv[++i], &ranges[k])) {
+                fprintf(stderr, "%s: expected first:last:step\n", names[k]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) workers = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc) limit_s = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--laps") && i + 1 < argc) laps = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc) seed = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--csv") && i + 1 < argc) csv = argv[++i];
+        else if (argv[i][0] != '-' && n_tracks < MAX_TRACKS) {
+            if (!load_track(&tracks[n_tracks], argv[i])) return 1;
+            n_tracks++;
+        } else {
+            fprintf(stderr,
+                    "usage: %s [--duty|--turn|--clear|--accel|--decel|--jerk|--antic|--pivot|--grip first:last:step]...\n"
+                    "       [-j workers] [-t seconds] [-s seed] [--laps n] [--csv file] track...\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (n_tracks == 0) {
+        fprintf(stderr, "no track files given, see tools/tracks/\n");
+        return 1;
+    }
+    if (laps < 1) laps = 1;
+    if (workers < 1) workers = 1;
+    if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+
+    for (k = 0; k < 9; k++) combinations *= (ranges[k].last - ranges[k].first) / ranges[k].step + 1;
+    runs = combinations * n_tracks;
+    if (runs > 0x7FFFFFFF) {
+        fprintf(stderr, "too many runs: %ld\n", runs);
+        return 1;
+    }
+    fprintf(stderr, "%ld combinations x %d tracks = %ld runs on %d workers\n", combinations, n_tracks, runs, workers);
+
+    size = sizeof *pool + runs * sizeof pool->results[0];
+    pool = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (pool == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    for (w = 0; w < workers; w++) {
+        atomic_init(&pool->share[w], pack((uint32_t)(runs * w / workers), (uint32_t)(runs * (w + 1) / workers)));
+    }
+    atomic_init(&pool->done, 0);
+
+    for (w = 0; w < workers; w++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0) {
+            worker(pool, w, workers, ranges);
+            _exit(0);
+        }
+    }
+    while (wait(NULL) > 0) {
+    }
+    if (atomic_load(&pool->done) != runs) {
+        fprintf(stderr, "only %ld of %ld runs finished\n", (long)atomic_load(&pool->done), runs);
+        return 1;
+    }
+
+    // Per combination: laps and off-line time added, the smallest clearance
+    scores = malloc(combinations * sizeof *scores);
+    for (i = 0; i < combinations; i++) {
+        struct score s = {i, 0, 1e9, 0};
+        for (t = 0; t < n_tracks; t++) {
+            const struct result *r = &pool->results[i * n_tracks + t];
+            if (r->lap_s < 0) break;
+            s.lap_s += r->lap_s;
+            s.offline_s += r->offline_s;
+            if (r->clear_mm < s.clear_mm) s.clear_mm = r->clear_mm;
+        }
+        if (t == n_tracks) scores[n_scores++] = s;
+    }
+    qsort(scores, n_scores, sizeof *scores, by_lap);
+
+    if (csv) {
+        FILE *f = fopen(csv, "w");
+        if (!f) {
+            perror(csv);
+            return 1;
+        }
+        fprintf(f, "dutymax,turn,clear,accel,decel,jerk,antic,pivot,grip,track,lap_s,clear_mm,offline_s\n");
+        for (i = 0; i < runs; i++) {
+            struct params p = combination(i / n_tracks, ranges);
+            const struct result *r = &pool->results[i];
+            fprintf(f, "%d,%d,%d,%d,%d,%d,%d,%d,%d,%s,", p.duty, p.turn, p.clear, p.accel, p.decel, p.jerk, p.antic,
+                    p.pivot, p.grip, tracks[i % n_tracks].name);
+            if (r->lap_s < 0) fprintf(f, ",,%.2f\n", r->offline_s);
+            else fprintf(f, "%.2f,%.0f,%.2f\n", r->lap_s, r->clear_mm >= 1e9f ? -1 : r->clear_mm, r->offline_s);
+        }
+        fclose(f);
+    }
+
+    printf("%ld of %ld combinations finished every track in %.0f s\n", n_scores, combinations, limit_s);
+    if (n_scores == 0) return 0;
+    print_front("Pareto front: lap time, clearance and off-line time", scores, n_scores, ranges, 1, 1);
+    print_front("Lap time against clearance", scores, n_scores, ranges, 1, 0);
+    print_front("Lap time against off-line time", scores, n_scores, ranges, 0, 1);
+    return 0;
+}